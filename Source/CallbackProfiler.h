@@ -0,0 +1,60 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Worst-case and average cost of processBlock callbacks.
+
+  Written from the audio thread, read from anywhere. Load is the callback's
+  run time divided by the duration of the audio it produced, so 1.0 means
+  the deadline was only just met.
+ */
+class CallbackProfiler
+{
+public:
+    struct Stats
+    {
+        juce::int64 numCallbacks = 0;
+        double worstMicroseconds = 0.0;
+        double meanMicroseconds = 0.0;
+        double worstLoad = 0.0;
+    };
+
+    void reset()
+    {
+        numCallbacks = 0;
+        totalMicroseconds = 0.0;
+        worstMicroseconds = 0.0;
+        worstLoad = 0.0;
+    }
+
+    void addCallback(double microseconds, int numSamples, double sampleRate)
+    {
+        double budget = numSamples * 1.0e6 / sampleRate;
+
+        numCallbacks.store(numCallbacks.load() + 1);
+        totalMicroseconds.store(totalMicroseconds.load() + microseconds);
+        if (microseconds > worstMicroseconds.load()) {
+            worstMicroseconds.store(microseconds);
+        }
+        if (budget > 0.0 && microseconds / budget > worstLoad.load()) {
+            worstLoad.store(microseconds / budget);
+        }
+    }
+
+    Stats getStats() const
+    {
+        Stats stats;
+        stats.numCallbacks = numCallbacks.load();
+        stats.worstMicroseconds = worstMicroseconds.load();
+        stats.meanMicroseconds = stats.numCallbacks > 0 ? totalMicroseconds.load() / stats.numCallbacks : 0.0;
+        stats.worstLoad = worstLoad.load();
+        return stats;
+    }
+
+private:
+    std::atomic<juce::int64> numCallbacks{ 0 };
+    std::atomic<double> totalMicroseconds{ 0.0 };
+    std::atomic<double> worstMicroseconds{ 0.0 };
+    std::atomic<double> worstLoad{ 0.0 };
+};
@@ -0,0 +1,109 @@
+#include "AlignmentEstimator.h"
+
+AlignmentEstimator::AlignmentEstimator()
+{
+}
+
+void AlignmentEstimator::prepare(int fftOrder, int newMaxLag)
+{
+    fftSize = 1 << fftOrder;
+
+    // Lags near half the frame alias, and the windows barely overlap there.
+    maxLag = juce::jmin(newMaxLag, fftSize / 4);
+
+    fft = std::make_unique<juce::dsp::FFT>(fftOrder);
+    crossSpectrum.assign(fftSize / 2 + 1, 0.0f);
+    correlation.assign(fftSize * 2, 0.0f);
+
+    reset();
+}
+
+void AlignmentEstimator::reset()
+{
+    std::fill(crossSpectrum.begin(), crossSpectrum.end(), 0.0f);
+    hopsSinceEstimate = 0;
+    stableEstimates = 0;
+    lastEstimate = 0.0f;
+    delay.store(0.0f, std::memory_order_relaxed);
+    locked.store(false, std::memory_order_relaxed);
+}
+
+void AlignmentEstimator::addFrame(const float* spectrum, const float* spectrumA, int padFactor, float auxDelay, bool lock)
+{
+    if (!lock) {
+        locked.store(false, std::memory_order_relaxed);
+        stableEstimates = 0;
+    }
+    else if (locked.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    // Every padFactor-th bin of a padded spectrum is the unpadded spectrum.
+    const auto* cdata = reinterpret_cast<const std::complex<float>*>(spectrum);
+    const auto* cdataA = reinterpret_cast<const std::complex<float>*>(spectrumA);
+    const int numBins = fftSize / 2 + 1;
+
+    // Delaying the aux input by d multiplies its spectrum by exp(-i w d), so
+    // the cross-power picks up exp(i w d). Rotating by exp(-i w d) undoes it.
+    const double step = -juce::MathConstants<double>::twoPi * auxDelay / fftSize;
+    const std::complex<double> rotationStep(std::cos(step), std::sin(step));
+    std::complex<double> rotation(1.0, 0.0);
+
+    for (int k = 0; k < numBins; ++k) {
+        auto cross = cdata[k * padFactor] * std::conj(cdataA[k * padFactor]);
+        cross *= std::complex<float>(rotation);
+        rotation *= rotationStep;
+
+        float re = cross.real(), im = cross.imag();
+        float magnitude = std::sqrt(re * re + im * im);
+        float scale = magnitude > 0.0f ? 1.0f / magnitude : 0.0f;
+
+        crossSpectrum[k] += smoothing * (std::complex<float>(re * scale, im * scale) - crossSpectrum[k]);
+    }
+
+    if (++hopsSinceEstimate >= hopsPerEstimate) {
+        hopsSinceEstimate = 0;
+        updateEstimate(lock);
+    }
+}
+
+void AlignmentEstimator::updateEstimate(bool lock)
+{
+    // The inverse transform of the cross-power spectrum is the
+    // cross-correlation, with negative lags wrapped to the end.
+    auto* cdata = reinterpret_cast<std::complex<float>*>(correlation.data());
+    std::copy(crossSpectrum.begin(), crossSpectrum.end(), cdata);
+    fft->performRealOnlyInverseTransform(correlation.data());
+
+    auto at = [this](int lag) { return correlation[(lag + fftSize) % fftSize]; };
+
+    int peakLag = 0;
+    for (int lag = -maxLag; lag <= maxLag; ++lag) {
+        if (at(lag) > at(peakLag)) {
+            peakLag = lag;
+        }
+    }
+
+    const float peak = at(peakLag);
+    if (peak < minPeak) {
+        stableEstimates = 0;
+        return;
+    }
+
+    // A parabola through the peak and its neighbours finds the fraction.
+    const float before = at(peakLag - 1), after = at(peakLag + 1);
+    const float curvature = before - 2.0f * peak + after;
+    const float fraction = curvature < 0.0f ? 0.5f * (before - after) / curvature : 0.0f;
+
+    // A peak at a positive lag means the aux input is that far ahead.
+    const float estimate = juce::jmax(0.0f, (float) peakLag + fraction);
+
+    stableEstimates = std::abs(estimate - lastEstimate) <= lockTolerance ? stableEstimates + 1 : 0;
+    lastEstimate = estimate;
+
+    delay.store(estimate, std::memory_order_relaxed);
+
+    if (lock && stableEstimates >= estimatesToLock) {
+        locked.store(true, std::memory_order_relaxed);
+    }
+}
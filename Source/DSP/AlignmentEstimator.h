@@ -0,0 +1,80 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+enum alignmentMode
+{
+    alignOff,       // 0
+    alignTrack,     // 1
+    alignLock       // 2
+};
+
+/**
+  Estimates how far the aux input is ahead of the main input, by GCC-PHAT on
+  the spectra FFTProcessor already has for each hop.
+
+  Every hop adds the phase of the cross-power spectrum (the PHAT weighting
+  throws its magnitude away) to a running average, at a cost of a few
+  multiplies per bin. Every few hops the average is transformed back into a
+  cross-correlation, and its peak, refined by parabolic interpolation, is
+  the lag. The aux spectra arrive already delayed by the current estimate,
+  so that delay is rotated back out of each hop first; the average then
+  tracks the raw offset rather than what's left of it.
+
+  The aux input can only be delayed, so an aux input that lags the main
+  input is left alone.
+ */
+class AlignmentEstimator
+{
+public:
+    AlignmentEstimator();
+
+    // maxLag is the longest offset to look for, in samples.
+    void prepare(int fftOrder, int maxLag);
+    void reset();
+
+    // Adds one hop. spectrum and spectrumA are the main and aux spectra
+    // before any processing, zero-padded by padFactor; auxDelay is the delay
+    // the aux frame was analysed with. Once `lock` has been set and the
+    // estimate has held steady for a while, it stops updating until `lock`
+    // is cleared again.
+    void addFrame(const float* spectrum, const float* spectrumA, int padFactor, float auxDelay, bool lock);
+
+    // The aux delay, in samples, that lines it up with the main input. Zero
+    // until the correlation peak is clear. Safe to call from any thread.
+    float getDelay() const { return delay.load(std::memory_order_relaxed); }
+    bool isLocked() const { return locked.load(std::memory_order_relaxed); }
+
+private:
+    void updateEstimate(bool lock);
+
+    // Fraction of each hop that goes into the running average.
+    static constexpr float smoothing = 0.05f;
+    static constexpr int hopsPerEstimate = 8;
+
+    // A lone, perfectly coherent peak is 1. Noise sits well below this.
+    static constexpr float minPeak = 0.2f;
+
+    // Consecutive estimates that must agree to within lockTolerance samples.
+    static constexpr int estimatesToLock = 6;
+    static constexpr float lockTolerance = 0.25f;
+
+    int fftSize = 0;
+    int maxLag = 0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+
+    // Smoothed PHAT cross-power spectrum, fftSize / 2 + 1 bins, and the
+    // scratch its correlation is computed in.
+    std::vector<std::complex<float>> crossSpectrum;
+    std::vector<float> correlation;
+
+    int hopsSinceEstimate = 0;
+    int stableEstimates = 0;
+    float lastEstimate = 0.0f;
+
+    std::atomic<float> delay{ 0.0f };
+    std::atomic<bool> locked{ false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AlignmentEstimator)
+};
@@ -0,0 +1,167 @@
+#include "AuxAnalyzer.h"
+
+AuxAnalyzer::AuxAnalyzer()
+{
+}
+
+void AuxAnalyzer::prepare(int fftOrder, windowFamily family)
+{
+    fftSize = 1 << fftOrder;
+
+    fft.prepare(fftOrder);
+    window.prepare(family, fftSize);
+
+    // Room for a frame at the longest delay plus the interpolator's taps.
+    fifoSize = fftSize + maxDelay + 4;
+
+    inputFifo.assign(fifoSize, 0.0f);
+    fftData.assign(fftSize * ZeroPaddedFFT::maxPadFactor + 2, 0.0f);
+    delayScratch.assign(fftSize + maxDelay + 4, 0.0f);
+
+    reset();
+}
+
+void AuxAnalyzer::reset()
+{
+    pos = 0;
+    samplesPushed = 0;
+    analysedAt = -1;
+    timelineOrigin = -1;
+    timelinePushed = 0;
+
+    std::fill(inputFifo.begin(), inputFifo.end(), 0.0f);
+}
+
+void AuxAnalyzer::pushBlock(const float* samples, int numSamples)
+{
+    samplesPushed += numSamples;
+
+    // Only the last fifoSize samples can end up in the FIFO.
+    if (numSamples > fifoSize) {
+        samples += numSamples - fifoSize;
+        pos = (pos + numSamples - fifoSize) % fifoSize;
+        numSamples = fifoSize;
+    }
+
+    const int first = std::min(numSamples, fifoSize - pos);
+    std::memcpy(inputFifo.data() + pos, samples, first * sizeof(float));
+    std::memcpy(inputFifo.data(), samples + first, (numSamples - first) * sizeof(float));
+
+    pos = (pos + numSamples) % fifoSize;
+}
+
+const float* AuxAnalyzer::getSpectrum(int padFactor)
+{
+    if (startAnalysis(padFactor)) {
+        fft.performForward(fftData.data(), padFactor);
+        finishAnalysis();
+    }
+
+    return fftData.data();
+}
+
+void AuxAnalyzer::analyseBatch(AuxAnalyzer* const* analyzers, int numAnalyzers, int padFactor)
+{
+    AuxAnalyzer* unpaired = nullptr;
+
+    for (int i = 0; i < numAnalyzers; ++i) {
+        AuxAnalyzer* analyzer = analyzers[i];
+        if (analyzer == nullptr || !analyzer->startAnalysis(padFactor)) {
+            continue;
+        }
+
+        if (unpaired == nullptr) {
+            unpaired = analyzer;
+            continue;
+        }
+
+        unpaired->fft.performForwardPair(unpaired->fftData.data(), analyzer->fftData.data(), padFactor);
+        unpaired->finishAnalysis();
+        analyzer->finishAnalysis();
+        unpaired = nullptr;
+    }
+
+    if (unpaired != nullptr) {
+        unpaired->fft.performForward(unpaired->fftData.data(), padFactor);
+        unpaired->finishAnalysis();
+    }
+}
+
+bool AuxAnalyzer::startAnalysis(int padFactor)
+{
+    if (analysedAt == samplesPushed && analysedPadFactor == padFactor) {
+        return false;
+    }
+    analysedAt = samplesPushed;
+    analysedPadFactor = padFactor;
+
+    float* fftPtr = fftData.data();
+
+    if (isShared() && sharedCache->fetch(sharedGroup, sharedChannel, getTimelineFrame(), fftSize, getSpectrumSize(), window.getFamily(), fftPtr)) {
+        return false;
+    }
+
+    copyFrame(fftPtr);
+    window.applyAnalysis(fftPtr);
+    return true;
+}
+
+void AuxAnalyzer::finishAnalysis()
+{
+    if (isShared()) {
+        sharedCache->publish(sharedGroup, sharedChannel, getTimelineFrame(), fftSize, getSpectrumSize(), window.getFamily(), fftData.data());
+    }
+}
+
+void AuxAnalyzer::copyFrame(float* dest) const
+{
+    // Unrolls the last numSamples samples of the circular buffer, oldest first.
+    auto unroll = [this](float* out, int numSamples) {
+        const int start = (pos - numSamples + fifoSize) % fifoSize;
+        const int first = std::min(numSamples, fifoSize - start);
+        std::memcpy(out, inputFifo.data() + start, first * sizeof(float));
+        std::memcpy(out + first, inputFifo.data(), (numSamples - first) * sizeof(float));
+    };
+
+    if (delay == 0.0f) {
+        unroll(dest, fftSize);
+        return;
+    }
+
+    const int whole = (int) delay;
+    const float d = 1.0f + (delay - (float) whole);
+
+    // history[n + 2] is where frame sample n would be without the fraction.
+    // The interpolator reads one sample ahead of it, so with a delay under
+    // one sample the last frame sample repeats the newest input instead.
+    const int numSamples = fftSize + whole + 2;
+    float* history = delayScratch.data();
+    unroll(history, numSamples);
+    history[numSamples] = history[numSamples - 1];
+
+    // Third-order Lagrange taps for a delay of d (1 to 2) behind history[n + 3].
+    const float h0 = -(d - 1.0f) * (d - 2.0f) * (d - 3.0f) / 6.0f;
+    const float h1 = d * (d - 2.0f) * (d - 3.0f) / 2.0f;
+    const float h2 = -d * (d - 1.0f) * (d - 3.0f) / 2.0f;
+    const float h3 = d * (d - 1.0f) * (d - 2.0f) / 6.0f;
+
+    for (int n = 0; n < fftSize; ++n) {
+        dest[n] = h0 * history[n + 3] + h1 * history[n + 2] + h2 * history[n + 1] + h3 * history[n];
+    }
+}
+
+void AuxAnalyzer::setSharedCache(SharedAuxCache* cache, int group, int channel)
+{
+    const bool valid = group >= 1 && group <= SharedAuxCache::numGroups
+                    && channel >= 0 && channel < SharedAuxCache::maxChannels;
+
+    sharedCache = valid ? cache : nullptr;
+    sharedGroup = group;
+    sharedChannel = channel;
+}
+
+void AuxAnalyzer::setTimelinePosition(juce::int64 position)
+{
+    timelineOrigin = position;
+    timelinePushed = samplesPushed;
+}
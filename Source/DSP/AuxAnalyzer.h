@@ -0,0 +1,113 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SharedAuxCache.h"
+#include "ZeroPaddedFFT.h"
+#include "STFTWindow.h"
+
+/**
+  Windowed forward FFT of one aux (sidechain) channel.
+
+  The analysis is computed lazily and cached per hop, so any number of
+  FFTProcessors that are routed to the same aux channel and hop on the same
+  sample share a single FFT instead of each recomputing it.
+ */
+class AuxAnalyzer
+{
+public:
+    // Longest delay setDelay() accepts, in samples.
+    static constexpr int maxDelay = 512;
+
+    AuxAnalyzer();
+
+    // The window must match the one used by the FFTProcessors reading it.
+    void prepare(int fftOrder, windowFamily family = hannWindow);
+    void reset();
+
+    // Push the next aux sample into the analysis FIFO.
+    void pushSample(float sample)
+    {
+        inputFifo[pos] = sample;
+        pos += 1;
+        if (pos == fifoSize) {
+            pos = 0;
+        }
+        samplesPushed += 1;
+    }
+
+    // Same as calling pushSample() for each of numSamples samples.
+    void pushBlock(const float* samples, int numSamples);
+
+    // Returns the spectrum of the last fftSize pushed samples, zero-padded by
+    // padFactor, as interleaved complex numbers. Only runs the FFT the first
+    // time it's called per sample.
+    const float* getSpectrum(int padFactor = 1);
+
+    // Analyses every analyzer in the list that getSpectrum() would, two to a
+    // complex FFT. nullptr entries are skipped. Afterwards getSpectrum() just
+    // returns the cached spectra.
+    static void analyseBatch(AuxAnalyzer* const* analyzers, int numAnalyzers, int padFactor);
+
+    // Copies the last fftSize pushed samples, oldest first, into dest. With
+    // a delay set, the frame ends that many samples before the last one.
+    void copyFrame(float* dest) const;
+
+    // Delays the analysed aux signal by a fractional number of samples, from
+    // 0 to maxDelay, to line it up with the main input. Fractions use
+    // third-order Lagrange interpolation. Takes effect from the next
+    // analysis. Hops aren't shared while a delay is set.
+    void setDelay(float samples) { delay = juce::jlimit(0.0f, (float) maxDelay, samples); }
+    float getDelay() const { return delay; }
+
+    // Shares this channel's analysis with other instances in the same
+    // sidechain group. Pass nullptr or group 0 to always analyse locally.
+    void setSharedCache(SharedAuxCache* cache, int group, int channel);
+
+    // Timeline position of the next sample to be pushed, or -1 if unknown.
+    // Hops are only shared while this is known.
+    void setTimelinePosition(juce::int64 position);
+
+private:
+    // Returns false if the spectrum is already cached or could be fetched
+    // from the shared cache. Otherwise leaves the windowed frame in fftData,
+    // ready for the forward FFT, after which finishAnalysis() must be called.
+    bool startAnalysis(int padFactor);
+    void finishAnalysis();
+
+    int getSpectrumSize() const { return ZeroPaddedFFT::getNumBins(fftSize, analysedPadFactor) * 2; }
+
+    // The hop is identified by the timeline position of its last sample.
+    bool isShared() const { return sharedCache != nullptr && timelineOrigin >= 0 && delay == 0.0f; }
+    juce::int64 getTimelineFrame() const { return timelineOrigin + (samplesPushed - timelinePushed) - 1; }
+
+    int fftSize = 0;
+
+    // The FIFO also holds the samples a delayed frame reaches back to.
+    int fifoSize = 0;
+    float delay = 0.0f;
+
+    ZeroPaddedFFT fft;
+    STFTWindow window;
+
+    // Write position in the input FIFO.
+    int pos = 0;
+
+    // Total samples pushed, and the value it had when fftData was last computed.
+    juce::int64 samplesPushed = 0;
+    juce::int64 analysedAt = -1;
+    int analysedPadFactor = 0;
+
+    std::vector<float> inputFifo;
+    std::vector<float> fftData;
+    mutable std::vector<float> delayScratch;
+
+    SharedAuxCache* sharedCache = nullptr;
+    int sharedGroup = 0;
+    int sharedChannel = 0;
+
+    // Timeline position at the time samplesPushed was timelinePushed.
+    juce::int64 timelineOrigin = -1;
+    juce::int64 timelinePushed = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AuxAnalyzer)
+};
@@ -1,23 +1,233 @@
 #include "FFTProcessor.h"
+#include "SpectralFrameCache.h"
+#include "SpectralKernels.h"
+#include "../SignalCapture.h"
 
-FFTProcessor::FFTProcessor() :
-    fft(fftOrder),
-    window(fftSize + 1, juce::dsp::WindowingFunction<float>::WindowingMethod::hann, false)
+FFTProcessor::FFTProcessor()
 {
-    // Note that the window is of length `fftSize + 1` because JUCE's windows
-    // are symmetrical, which is wrong for overlap-add processing. To make the
-    // window periodic, set size to 1025 but only use the first 1024 samples.
+    setFFTOrder(fftOrder);
+}
+
+FFTProcessor::~FFTProcessor()
+{
+    setPipelined(false);
+
+    delete pendingMorphTable.exchange(nullptr);
+    delete retiredMorphTable.exchange(nullptr);
 }
 
 void FFTProcessor::reset()
 {
-    count = 0;
+    // Frames land hopOffset samples later (mod hopSize) than they would for
+    // an unstaggered processor reset at the same time.
+    count = (hopSize - hopOffset) % hopSize;
     pos = 0;
+    inputPos = 0;
+    bypassState = processing;
+    fadePosition = 0;
 
     // Zero out the circular buffers.
     std::fill(inputFifo.begin(), inputFifo.end(), 0.0f);
-    std::fill(inputFifoA.begin(), inputFifoA.end(), 0.0f);
     std::fill(outputFifo.begin(), outputFifo.end(), 0.0f);
+
+    localAux.reset();
+
+    cancelPendingJobs();
+    aligner.reset();
+    smoother.reset();
+    smootherStale = false;
+}
+
+void FFTProcessor::abandonPendingJobs()
+{
+    if (pipeline == nullptr) {
+        return;
+    }
+
+    // Stale queue entries are skipped by the worker once their job is idle.
+    // A running job ends up done, and is reused like any other late one.
+    for (auto& job : pipeline->jobs) {
+        int expected = Job::queued;
+        job.state.compare_exchange_strong(expected, Job::idle);
+    }
+    pipeline->pendingJob = -1;
+}
+
+void FFTProcessor::cancelPendingJobs()
+{
+    if (pipeline == nullptr) {
+        return;
+    }
+
+    abandonPendingJobs();
+
+    // Jobs only run while `busy` is held, so once it's free none is running.
+    while (pipeline->busy.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    for (auto& job : pipeline->jobs) {
+        job.state = Job::idle;
+    }
+    std::fill(pipeline->lastFrame.begin(), pipeline->lastFrame.end(), 0.0f);
+}
+
+void FFTProcessor::setFFTOrder(int newOrder)
+{
+    jassert(newOrder > 0 && (1 << newOrder) >= maxOverlap);
+
+    // The worker may still be running a frame of the old size.
+    cancelPendingJobs();
+
+    fftOrder = newOrder;
+    fftSize = 1 << fftOrder;
+    hopSize = fftSize / overlap;
+    hopOffset = hopOffset % hopSize;
+    count = count % hopSize;
+
+    historySize = 2 * fftSize;
+    historyMask = historySize - 1;
+    inputPos = 0;
+    pos = 0;
+
+    inputFifo.assign(historySize, 0.0f);
+    outputFifo.assign(fftSize, 0.0f);
+    fftData.assign(getMaxSpectrumSize(), 0.0f);
+    silentAux.assign(getMaxSpectrumSize(), 0.0f);
+    morphMagnitudes.assign(getMaxSpectrumSize() / 2, 0.0f);
+    allocateJobs();
+
+    fft.prepare(fftOrder);
+    window.prepare(window.getFamily(), fftSize, overlap);
+    localAux.prepare(fftOrder, window.getFamily());
+    aligner.prepare(fftOrder, AuxAnalyzer::maxDelay);
+    smoother.prepare(getMaxSpectrumSize() / 2);
+
+    // Tables are rasterised for one frame size, so any still in flight are
+    // stale. Nothing is processing, so they can all go.
+    delete pendingMorphTable.exchange(nullptr);
+    delete retiredMorphTable.exchange(nullptr);
+    morphTable = morphCurve.createTable(fftSize);
+}
+
+void FFTProcessor::setWindow(windowFamily family, int newOverlap)
+{
+    jassert(newOverlap >= 2 && newOverlap <= maxOverlap && juce::isPowerOfTwo(newOverlap));
+
+    if (family == window.getFamily() && newOverlap == overlap) {
+        return;
+    }
+
+    // The worker may still be windowing a frame from before.
+    cancelPendingJobs();
+
+    overlap = newOverlap;
+    hopSize = fftSize / overlap;
+    hopOffset = hopOffset % hopSize;
+    count = count % hopSize;
+
+    window.prepare(family, fftSize, overlap);
+    localAux.prepare(fftOrder, family);
+}
+
+void FFTProcessor::setPipelined(bool shouldBePipelined)
+{
+    if (shouldBePipelined == (pipeline != nullptr)) {
+        return;
+    }
+
+    if (shouldBePipelined) {
+        pipeline = std::make_unique<Pipeline>();
+        allocateJobs();
+        pipeline->workerThread = pipeline->worker->add(this);
+    }
+    else {
+        pipeline->worker->remove(this);
+        pipeline.reset();
+    }
+}
+
+void FFTProcessor::setMorphCurve(const MorphCurve& curve)
+{
+    // The audio thread only fills the retired slot when it's empty, so once
+    // it's been emptied here it stays that way until the next pick-up.
+    delete retiredMorphTable.exchange(nullptr, std::memory_order_acquire);
+
+    morphCurve = curve;
+
+    // A table that was never picked up is still ours to free.
+    delete pendingMorphTable.exchange(curve.createTable(fftSize).release(), std::memory_order_acq_rel);
+}
+
+void FFTProcessor::allocateJobs()
+{
+    if (pipeline == nullptr) {
+        return;
+    }
+
+    for (auto& job : pipeline->jobs) {
+        job.fftData.assign(getMaxSpectrumSize(), 0.0f);
+        for (auto& fftDataA : job.fftDataA) {
+            fftDataA.assign(getMaxSpectrumSize(), 0.0f);
+        }
+    }
+    pipeline->lastFrame.assign(fftSize, 0.0f);
+}
+
+void FFTProcessor::setCapture(SignalCapture* newCapture, int channel)
+{
+    capture = newCapture;
+    captureChannel = channel;
+}
+
+void FFTProcessor::updateMorphTable()
+{
+    // Leave the new table pending until the last retired one has been freed.
+    if (retiredMorphTable.load(std::memory_order_relaxed) != nullptr) {
+        return;
+    }
+
+    if (auto* next = pendingMorphTable.exchange(nullptr, std::memory_order_acq_rel)) {
+        retiredMorphTable.store(morphTable.release(), std::memory_order_release);
+        morphTable.reset(next);
+    }
+}
+
+void FFTProcessor::runPendingJobs()
+{
+    // The audio thread is running a late job itself. Whatever is queued
+    // behind it is picked up on the next wake-up, or taken back.
+    if (pipeline->busy.exchange(true, std::memory_order_acquire)) {
+        return;
+    }
+
+    int start1, size1, start2, size2;
+    pipeline->queue.prepareToRead(pipeline->queue.getNumReady(), start1, size1, start2, size2);
+
+    auto runSlots = [this](int start, int size) {
+        for (int i = start; i < start + size; ++i) {
+            Job& job = pipeline->jobs[pipeline->queueSlots[i]];
+
+            // Skip jobs the audio thread has already taken back.
+            int expected = Job::queued;
+            if (job.state.compare_exchange_strong(expected, Job::running, std::memory_order_acquire)) {
+                runJob(job);
+            }
+        }
+    };
+
+    runSlots(start1, size1);
+    runSlots(start2, size2);
+
+    pipeline->queue.finishedRead(size1 + size2);
+    pipeline->busy.store(false, std::memory_order_release);
+}
+
+void FFTProcessor::setHopOffset(int offset)
+{
+    jassert(offset >= 0 && offset < hopSize);
+
+    count = ((count + hopOffset - offset) % hopSize + hopSize) % hopSize;
+    hopOffset = offset;
 }
 
 void FFTProcessor::processBlock(float* data, float* dataA, int numSamples, ChainSettings settings)
@@ -27,12 +237,28 @@ void FFTProcessor::processBlock(float* data, float* dataA, int numSamples, Chain
     }
 }
 
-// Function that counts samples, and then calls processFrame once there's enough samples gathered to perform the FFT
 float FFTProcessor::processSample(float sample, float sampleA, ChainSettings settings)
 {
+    localAux.pushSample(sampleA);
+    return processSample(sample, &localAux, settings);
+}
+
+float FFTProcessor::processSample(float sample, AuxAnalyzer* aux, ChainSettings settings)
+{
+    return processSample(sample, AuxSources{ aux }, settings);
+}
+
+// Function that counts samples, and then calls processFrame once there's enough samples gathered to perform the FFT
+float FFTProcessor::processSample(float sample, const AuxSources& aux, ChainSettings settings)
+{
+    bool shouldBypass = settings.bypassed > 0.5f;
+    if (shouldBypass || bypassState != processing) {
+        updateBypassState(shouldBypass);
+    }
+
     // Push the new sample value into the input FIFO.
-    inputFifo[pos] = sample;
-    inputFifoA[pos] = sampleA;
+    inputFifo[inputPos] = sample;
+    inputPos = (inputPos + 1) & historyMask;
 
     // Read the output value from the output FIFO. Since it takes fftSize
     // timesteps before actual samples are read from this FIFO instead of
@@ -54,291 +280,507 @@ float FFTProcessor::processSample(float sample, float sampleA, ChainSettings set
     count += 1;
     if (count == hopSize) {
         count = 0;
-        processFrame(settings);
+        if (bypassState != bypassed) {
+            processFrame(aux, settings);
+        }
+    }
+
+    if (bypassState != processing) {
+        // The input from exactly one latency ago lines up with the STFT output.
+        float dry = inputFifo[(inputPos - 1 - getLatencyInSamples()) & historyMask];
+        outputSample = mixBypass(outputSample, dry);
     }
 
     return outputSample;
 }
 
-// Function that performs the FFT and calls processSpectrum
-void FFTProcessor::processFrame(ChainSettings settings)
+void FFTProcessor::processBypassedBlock(float* data, int numSamples)
 {
-    const float* inputPtr = inputFifo.data();
-    const float* inputPtrA = inputFifoA.data();
-    float* fftPtr = fftData.data();
-    float* fftPtrA = fftDataA.data();
+    jassert(bypassState == bypassed);
 
-    bool bypassed = settings.bypassed;
+    const int latency = getLatencyInSamples();
 
-    // Copy the input FIFO into the FFT working space in two parts.
-    std::memcpy(fftPtr, inputPtr + pos, (fftSize - pos) * sizeof(float));
-    std::memcpy(fftPtrA, inputPtrA + pos, (fftSize - pos) * sizeof(float));
-    if (pos > 0) {
-        std::memcpy(fftPtr + fftSize - pos, inputPtr, pos * sizeof(float));
-        std::memcpy(fftPtrA + fftSize - pos, inputPtrA, pos * sizeof(float));
-    }
+    // Write each chunk into the history before reading the delayed input back
+    // over it. The read lags the write by `latency`, so the two only overlap
+    // if a chunk is longer than the rest of the history.
+    const int maxChunk = historySize - latency;
 
-    // Apply the window to avoid spectral leakage.
-    window.multiplyWithWindowingTable(fftPtr, fftSize);
-    window.multiplyWithWindowingTable(fftPtrA, fftSize);
+    for (int start = 0; start < numSamples; start += maxChunk) {
+        const int chunk = std::min(maxChunk, numSamples - start);
+        float* chunkData = data + start;
 
-    if (!bypassed) {
-        // Perform the forward FFT.
-        fft.performRealOnlyForwardTransform(fftPtr, true);
-        fft.performRealOnlyForwardTransform(fftPtrA, true);
+        copyToHistory(chunkData, inputPos, chunk);
+        copyFromHistory(chunkData, (inputPos - latency) & historyMask, chunk);
+        inputPos = (inputPos + chunk) & historyMask;
+    }
 
-        // Do stuff with the FFT data.
-        processSpectrum(fftPtr, fftPtrA, numBins, settings);
+    // Keep the hop phase and output position where processSample() would
+    // have left them. The output FIFO is all zeros while bypassed.
+    pos = (pos + numSamples) % fftSize;
+    count = (count + numSamples) % hopSize;
+}
 
-        // Perform the inverse FFT.
-        fft.performRealOnlyInverseTransform(fftPtr);
-    }
+void FFTProcessor::copyToHistory(const float* source, int start, int numSamples)
+{
+    const int first = std::min(numSamples, historySize - start);
+    std::memcpy(inputFifo.data() + start, source, first * sizeof(float));
+    std::memcpy(inputFifo.data(), source + first, (numSamples - first) * sizeof(float));
+}
 
-    // Apply the window again for resynthesis.
-    window.multiplyWithWindowingTable(fftPtr, fftSize);
+void FFTProcessor::copyFromHistory(float* dest, int start, int numSamples) const
+{
+    const int first = std::min(numSamples, historySize - start);
+    std::memcpy(dest, inputFifo.data() + start, first * sizeof(float));
+    std::memcpy(dest + first, inputFifo.data(), (numSamples - first) * sizeof(float));
+}
 
-    // Scale down the output samples because of the overlapping windows.
-    for (int i = 0; i < fftSize; ++i) {
-        fftPtr[i] *= windowCorrection;
+void FFTProcessor::updateBypassState(bool shouldBypass)
+{
+    switch (bypassState)
+    {
+    case processing:
+        // Only called here once bypass has been switched on.
+        bypassState = fadingOut;
+        fadePosition = 0;
+        break;
+    case fadingOut:
+        if (!shouldBypass) {
+            // Turn the fade around from where it is; the STFT is still running.
+            bypassState = fadingIn;
+            fadePosition = hopSize - fadePosition;
+        }
+        break;
+    case bypassed:
+        if (!shouldBypass) {
+            bypassState = warmingUp;
+            fadePosition = 0;
+        }
+        break;
+    case warmingUp:
+        if (shouldBypass) {
+            enterBypassed();
+        }
+        break;
+    case fadingIn:
+        if (shouldBypass) {
+            bypassState = fadingOut;
+            fadePosition = hopSize - fadePosition;
+        }
+        break;
     }
+}
 
-    // Add the IFFT results to the output FIFO.
-    for (int i = 0; i < pos; ++i) {
-        outputFifo[i] += fftData[i + fftSize - pos];
+float FFTProcessor::mixBypass(float wet, float dry)
+{
+    switch (bypassState)
+    {
+    case fadingOut: {
+        float gain = 1.0f - (float) fadePosition / hopSize;
+        if (++fadePosition >= hopSize) {
+            enterBypassed();
+        }
+        return dry + gain * (wet - dry);
     }
-    for (int i = 0; i < fftSize - pos; ++i) {
-        outputFifo[i + pos] += fftData[i];
+    case warmingUp:
+        // Frames that would have run during the bypass are missing from the
+        // output FIFO, so it isn't complete until a full latency has gone by.
+        if (++fadePosition >= getLatencyInSamples()) {
+            bypassState = fadingIn;
+            fadePosition = 0;
+        }
+        return dry;
+    case fadingIn: {
+        float gain = (float) fadePosition / hopSize;
+        if (++fadePosition >= hopSize) {
+            bypassState = processing;
+        }
+        return dry + gain * (wet - dry);
     }
+    case processing:
+        return wet;
+    case bypassed:
+        break;
+    }
+    return dry;
 }
 
-// Function that calls the phase/magnitude processors
-void FFTProcessor::processSpectrum(float* data, float* dataA, int numBins, ChainSettings settings)
+void FFTProcessor::enterBypassed()
 {
-    // The spectrum data is floats organized as [re, im, re, im, ...]
-    // but it's easier to deal with this as std::complex values.
-    auto* cdata = reinterpret_cast<std::complex<float>*>(data);
-    auto* cdataA = reinterpret_cast<std::complex<float>*>(dataA);
-
-    int magMethod = settings.magProcessing;
-    int phaseMethod = settings.phaseProcessing;
+    bypassState = bypassed;
 
+    // Nothing is overlap-added while bypassed, so anything left would be
+    // stale by the time processing resumes.
+    std::fill(outputFifo.begin(), outputFifo.end(), 0.0f);
 
-    // Choose method of magnitude processing
-    switch (magMethod)
-    {
-    case magProcessing::addM: addAverageMagnitude(cdata, cdataA, numBins, settings); break;
-    case magProcessing::subtract: subtractAverageMagnitude(cdata, cdataA, numBins, settings); break;
-    case magProcessing::multiply: multiplyAverageMagnitude(cdata, cdataA, numBins, settings); break;
-    case magProcessing::divide: divideAverageMagnitude(cdata, cdataA, numBins, settings); break;
-    case magProcessing::linearBlend: linearBlendMagnitude(cdata, cdataA, numBins, settings); break;
-    case magProcessing::allPass: break;
+    // This is the audio thread, so a frame the worker is part-way through
+    // is left to finish rather than waited for.
+    if (pipeline != nullptr) {
+        abandonPendingJobs();
+        smootherStale = true;
     }
-
-    // Choose method of phase processing
-    switch (phaseMethod)
-    {
-    case phaseProcessing::addP: averagePhase(cdata, cdataA, numBins, settings); break;
-    case phaseProcessing::linear: linearPhase(cdata, numBins, settings); break;
-    case phaseProcessing::linearNatural: linearNaturalPhase(cdata, cdataA, numBins, settings); break;
-    case phaseProcessing::smoothStep: smoothStepPhase(cdata, cdataA, numBins, settings); break;
-    case phaseProcessing::preserveMainIn: break;
-    case phaseProcessing::preserveAuxIn: preserveAuxInPhase(cdata, cdataA, numBins, settings); break;
+    else {
+        smoother.reset();
     }
-
-    if (settings.invertPhase) invertPhase(cdata, numBins, settings);
 }
 
+void FFTProcessor::copyInputFrame(float* dest) const
+{
+    copyFromHistory(dest, (inputPos - fftSize) & historyMask, fftSize);
+}
 
-// Phase Processing Functions
-void FFTProcessor::averagePhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings)
+// Function that performs the FFT and calls processSpectrum
+void FFTProcessor::processFrame(const AuxSources& aux, ChainSettings settings)
 {
-    float morphFactor = settings.morphFactor;
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float magnitudeA = std::abs(cdataA[i]);
-        float phaseA = std::arg(cdataA[i]);
+    if (pipeline != nullptr) {
+        processFramePipelined(aux, settings);
+        return;
+    }
 
-        float morphedPhase = (phase * morphFactor) + (phaseA * (1.0f - morphFactor));
+    updateMorphTable();
 
-        cdata[i] = std::polar(magnitude, morphedPhase);
-    }
-}
-void FFTProcessor::linearPhase(std::complex<float>* cdata, int numBins, ChainSettings settings)
-{
-    std::vector<float> linearPhase = linspace(-3.14f, 3.14f, numBins);
+    float* fftPtr = fftData.data();
+    int padFactor = 1 << (int) settings.zeroPadding;
 
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = linearPhase[i];
+    // Copy the last fftSize input samples into the FFT working space.
+    copyInputFrame(fftPtr);
 
-        // Wrap phase to the range [-pi, pi] to avoid discontinuities
-        if (phase > 3.14f) phase -= 2.0f * 3.14f;
-        if (phase < -3.14f) phase += 2.0f * 3.14f;
+    // The aux spectra are analysed (or picked up from another channel that
+    // already analysed them) by the AuxAnalyzers.
+    const int numSources = getNumAuxSources(settings);
+    AuxAnalyzer::analyseBatch(aux.data(), numSources, padFactor);
 
-        cdata[i] = std::polar(magnitude, phase);
+    const float* auxSpectra[maxAuxSources] = {};
+    for (int i = 0; i < numSources; ++i) {
+        auxSpectra[i] = aux[i] != nullptr ? aux[i]->getSpectrum(padFactor) : nullptr;
     }
+
+    float auxDelay = aux[0] != nullptr ? aux[0]->getDelay() : 0.0f;
+    transformFrame(fftPtr, auxSpectra, auxDelay, padFactor, settings);
+    overlapAdd(fftPtr);
 }
-void FFTProcessor::linearNaturalPhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings) 
-{
-    // Generate a linear phase ramp from -pi to pi
-    std::vector<float> linearPhase = linspace(-3.14f, 3.14f, numBins);
 
-    float morphFactor = settings.morphFactor;  // Value between 0 and 1
+void FFTProcessor::processFramePipelined(const AuxSources& aux, ChainSettings settings)
+{
+    // Collect last hop's frame. Adding it now rather than then is what
+    // delays the output by an extra hop.
+    if (pipeline->pendingJob >= 0) {
+        Job& job = pipeline->jobs[pipeline->pendingJob];
+
+        // The worker didn't get to it in time, so run it here.
+        tryRunJob(job);
+
+        if (nonRealtime) {
+            // Offline there's no deadline, so wait for the worker rather
+            // than change the output.
+            while (job.state.load(std::memory_order_acquire) != Job::done) {
+                tryRunJob(job);
+                std::this_thread::yield();
+            }
+        }
+
+        if (job.state.load(std::memory_order_acquire) == Job::done) {
+            std::copy(job.fftData.begin(), job.fftData.begin() + fftSize, pipeline->lastFrame.begin());
+            job.state.store(Job::idle, std::memory_order_relaxed);
+        }
+        else {
+            // The worker is still busy, with this frame or one before it.
+            // Waiting here could take any amount of time, so the frame is
+            // dropped and the last one repeated in its place.
+            int expected = Job::queued;
+            job.state.compare_exchange_strong(expected, Job::idle);
+        }
+
+        overlapAdd(pipeline->lastFrame.data());
+        pipeline->pendingJob = -1;
+    }
 
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float phaseA = std::arg(cdataA[i]);
+    // The table can only change while no job is reading it.
+    if (!pipeline->busy.exchange(true, std::memory_order_acquire)) {
+        updateMorphTable();
+        pipeline->busy.store(false, std::memory_order_release);
+    }
 
-        // Compute the average of the two input phases
-        float averageMorphedPhase = (phase * morphFactor) + (phaseA * (1.0f - morphFactor));
-        
+    // Any job that isn't running is free. At most one runs at a time, so
+    // with three there's always one.
+    int index = -1;
+    for (int i = 0; i < (int) std::size(pipeline->jobs) && index < 0; ++i) {
+        int state = pipeline->jobs[i].state.load(std::memory_order_acquire);
+        if (state == Job::idle || state == Job::done) {
+            index = i;
+        }
+    }
+    jassert(index >= 0);
+    if (index < 0) {
+        return;
+    }
 
-        // Blend between the forced linear phase and the average phase
-        float blendedPhase = (1.0f - morphFactor) * averageMorphedPhase + morphFactor * linearPhase[i];
+    Job& job = pipeline->jobs[index];
 
-        // Wrap phase to the range [-pi, pi] to avoid discontinuities
-        if (blendedPhase > 3.14f) blendedPhase -= 2.0f * 3.14f;
-        if (blendedPhase < -3.14f) blendedPhase += 2.0f * 3.14f;
+    // Copy the input FIFO (and the aux FIFO) into the job.
+    copyInputFrame(job.fftData.data());
 
-        // Reconstruct the complex number with the morphed magnitude and blended phase
-        cdata[i] = std::polar(magnitude, blendedPhase);
+    const int numSources = getNumAuxSources(settings);
+    for (int i = 0; i < maxAuxSources; ++i) {
+        job.hasAux[i] = i < numSources && aux[i] != nullptr;
+        if (job.hasAux[i]) {
+            aux[i]->copyFrame(job.fftDataA[i].data());
+        }
+    }
+    job.settings = settings;
+    job.auxDelay = aux[0] != nullptr ? aux[0]->getDelay() : 0.0f;
+    job.resetSmoother = std::exchange(smootherStale, false);
+    job.state.store(Job::queued, std::memory_order_release);
+
+    int start1, size1, start2, size2;
+    pipeline->queue.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 > 0) {
+        pipeline->queueSlots[start1] = index;
+        pipeline->queue.finishedWrite(1);
+        pipeline->worker->wake(pipeline->workerThread);
     }
+    // If the queue is full the job stays queued and is run here next hop.
+
+    pipeline->pendingJob = index;
 }
-void FFTProcessor::smoothStepPhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings) 
+
+bool FFTProcessor::tryRunJob(Job& job)
 {
-    float morphFactor = settings.morphFactor;
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float magnitudeA = std::abs(cdataA[i]);
-        float phaseA = std::arg(cdataA[i]);
-        float blendCurve = 3 * morphFactor * morphFactor - 2 * morphFactor * morphFactor * morphFactor;  // Smoothstep function
-        float morphedPhase = blendCurve * phase + (1 - blendCurve) * phaseA;
+    if (pipeline->busy.exchange(true, std::memory_order_acquire)) {
+        return false;
+    }
 
-        cdata[i] = std::polar(magnitude, morphedPhase);
+    int expected = Job::queued;
+    bool claimed = job.state.compare_exchange_strong(expected, Job::running, std::memory_order_acquire);
+    if (claimed) {
+        runJob(job);
     }
+
+    pipeline->busy.store(false, std::memory_order_release);
+    return claimed;
 }
-void FFTProcessor::preserveAuxInPhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings) 
+
+void FFTProcessor::runJob(Job& job)
 {
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phaseA = std::arg(cdataA[i]);
-        cdata[i] = std::polar(magnitude, phaseA);
+    if (job.resetSmoother) {
+        smoother.reset();
     }
-}
-void FFTProcessor::invertPhase(std::complex<float>* cdata, int numBins, ChainSettings settings)
-{
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        cdata[i] = std::polar(magnitude, -phase);
+
+    int padFactor = 1 << (int) job.settings.zeroPadding;
+    const float* auxSpectra[maxAuxSources] = {};
+    float* unpaired = nullptr;
+
+    // Aux frames are transformed two to an FFT, as in AuxAnalyzer::analyseBatch().
+    for (int i = 0; i < maxAuxSources; ++i) {
+        if (!job.hasAux[i]) {
+            continue;
+        }
+
+        float* frame = job.fftDataA[i].data();
+        window.applyAnalysis(frame);
+        auxSpectra[i] = frame;
+
+        if (unpaired == nullptr) {
+            unpaired = frame;
+        }
+        else {
+            fft.performForwardPair(unpaired, frame, padFactor);
+            unpaired = nullptr;
+        }
+    }
+
+    if (unpaired != nullptr) {
+        fft.performForward(unpaired, padFactor);
     }
+
+    transformFrame(job.fftData.data(), auxSpectra, job.auxDelay, padFactor, job.settings);
+
+    job.state.store(Job::done, std::memory_order_release);
 }
 
-// Magnitude Processing Functions
-void FFTProcessor::addAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings)
+void FFTProcessor::transformFrame(float* data, const float* const* auxSpectra, float auxDelay, int padFactor, ChainSettings settings)
 {
-    float morphFactor = settings.morphFactor;
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float magnitudeA = std::abs(cdataA[i]);
-        float phaseA = std::arg(cdataA[i]);
+    // Apply the window to avoid spectral leakage.
+    window.applyAnalysis(data);
 
-        float morphedMagnitude = (magnitude * morphFactor) + (magnitudeA * (1.0f - morphFactor));
+    // Perform the forward FFT.
+    fft.performForward(data, padFactor);
 
-        cdata[i] = std::polar(morphedMagnitude, phase);
+    // Both spectra are at hand before processing, so the alignment estimate
+    // only costs the cross-power update.
+    int alignment = settings.alignment;
+    if (alignment != alignOff && auxSpectra[0] != nullptr) {
+        aligner.addFrame(data, auxSpectra[0], padFactor, auxDelay, alignment == alignLock);
     }
-}
-void FFTProcessor::subtractAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings)
-{
-    float morphFactor = settings.morphFactor;
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float magnitudeA = std::abs(cdataA[i]);
-        float phaseA = std::arg(cdataA[i]);
 
-        float morphedMagnitude = std::abs((magnitude * morphFactor) - (magnitudeA * (1.0f - morphFactor)));
+    // Do stuff with the FFT data.
+    const int numPaddedBins = ZeroPaddedFFT::getNumBins(fftSize, padFactor);
+    processSpectrum(data, auxSpectra, numPaddedBins, settings);
 
-        cdata[i] = std::polar(morphedMagnitude, phase);
+    if (capture != nullptr) {
+        capture->pushSpectrum(captureChannel, data, numPaddedBins);
     }
-}
-void FFTProcessor::multiplyAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings)
-{
-    float morphFactor = settings.morphFactor;
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float magnitudeA = std::abs(cdataA[i]);
-        float phaseA = std::arg(cdataA[i]);
 
-        float morphedMagnitude = std::abs((magnitude * morphFactor) * (magnitudeA * (1.0f - morphFactor)));
+    // Perform the inverse FFT. Only the first fftSize samples come back.
+    fft.performInverse(data, padFactor);
 
-        float normalizationFactor = std::max(magnitude * magnitudeA, 1.0f);
-        morphedMagnitude /= normalizationFactor;
+    // Apply the window again for resynthesis. The synthesis table also
+    // scales the output down to make up for the overlapping windows.
+    window.applySynthesis(data);
+}
 
-        cdata[i] = std::polar(morphedMagnitude, phase);
+void FFTProcessor::overlapAdd(const float* frame)
+{
+    // Add the IFFT results to the output FIFO.
+    for (int i = 0; i < pos; ++i) {
+        outputFifo[i] += frame[i + fftSize - pos];
+    }
+    for (int i = 0; i < fftSize - pos; ++i) {
+        outputFifo[i + pos] += frame[i];
     }
 }
-void FFTProcessor::divideAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings)
+
+bool FFTProcessor::renderFromCache(const SpectralFrameCache& cache, float* output, int numSamples, ChainSettings settings)
 {
-    float morphFactor = settings.morphFactor;
-    for (int i = 0; i < numBins; ++i) {
-        float magnitude = std::abs(cdata[i]);
-        float phase = std::arg(cdata[i]);
-        float magnitudeA = std::abs(cdataA[i]);
-        float phaseA = std::arg(cdataA[i]);
+    // Frames analysed with another frame size, hop or window would
+    // resynthesise as garbage, so that's an error rather than a render.
+    if (!cache.isOpen() || cache.getFFTSize() != fftSize || cache.getHopSize() != hopSize
+        || cache.getWindow() != window.getFamily()) {
+        std::fill(output, output + numSamples, 0.0f);
+        return false;
+    }
+
+    float* fftPtr = fftData.data();
+    std::vector<float> auxScratch(cache.getNumBins() * 2);
 
-        // Avoid division by zero by clamping magnitudeA to a small positive value
-        float safeMagnitudeA = std::max(magnitudeA * (1.0f - morphFactor), 1e-6f);
+    std::fill(output, output + numSamples, 0.0f);
+    smoother.reset();
 
-        // Perform division with morphing factors
-        float morphedMagnitude = (magnitude * morphFactor) / safeMagnitudeA;
+    for (int frame = 0; frame < cache.getNumFrames(); ++frame) {
+        updateMorphTable();
 
-        // Optional: Clamp to avoid extremely large values
-        morphedMagnitude = std::min(morphedMagnitude, 1.0f);  // Assuming normalized input
+        cache.readMainFrame(frame, fftPtr);
+        const float* fftPtrA = cache.getAuxFrame(frame, auxScratch.data());
 
-        cdata[i] = std::polar(morphedMagnitude, phase);
+        const float* auxSpectra[maxAuxSources] = { fftPtrA };
+        processSpectrum(fftPtr, auxSpectra, cache.getNumBins(), settings);
+        fft.performInverse(fftPtr, cache.getPadFactor());
+
+        window.applySynthesis(fftPtr);
+
+        // processSample() runs this frame after its last input sample and
+        // starts reading it out on the next one.
+        const int start = (frame + 1) * hopSize;
+        const int end = std::min(start + fftSize, numSamples);
+        for (int i = start; i < end; ++i) {
+            output[i] += fftPtr[i - start];
+        }
     }
+
+    return true;
 }
-void FFTProcessor::linearBlendMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings)
+
+// Function that calls the phase/magnitude processors
+void FFTProcessor::processSpectrum(float* data, const float* const* auxSpectra, int numBins, ChainSettings settings)
 {
-    // Create a linear blending curve from 0 to 1 across the frequency bins
-    std::vector<float> blendCurve = linspace(0.0f, 1.0f, numBins);
+    const float* dataA = auxSpectra[0] != nullptr ? auxSpectra[0] : silentAux.data();
 
-    for (int i = 0; i < numBins; ++i) {
-        float magnitudeA = std::abs(cdataA[i]);
-        float magnitudeB = std::abs(cdata[i]);
+    // The spectrum data is floats organized as [re, im, re, im, ...]
+    // but it's easier to deal with this as std::complex values.
+    auto* cdata = reinterpret_cast<std::complex<float>*>(data);
+    auto* cdataA = reinterpret_cast<const std::complex<float>*>(dataA);
 
-        // Use the blend curve to crossfade between magnitudes
-        float blendedMagnitude = blendCurve[i] * magnitudeA + (1.0f - blendCurve[i]) * magnitudeB;
+    int magMethod = settings.magProcessing;
+    int phaseMethod = settings.phaseProcessing;
+
+    if (magMethod == magProcessing::weightedMorph) {
+        weightedMorphMagnitude(cdata, auxSpectra, numBins, settings);
+    }
+
+    // Magnitude processing, phase processing and phase inversion run as one
+    // kernel specialised for this combination of modes.
+    SpectralKernels::Params params;
+    params.morphFactor = settings.morphFactor;
+    if (magMethod == magProcessing::linearBlend) {
+        // Per-bin blend amounts from the drawn morph curve, 0 to 1 across
+        // the frequency bins by default.
+        params.blendCurve = morphTable->getGains(numBins);
+    }
 
-        // Preserve the original phase from cdataA (or you can mix the phases if desired)
-        float phase = std::arg(cdata[i]);
+    auto kernel = SpectralKernels::get(magMethod, phaseMethod, settings.invertPhase > 0.5f);
+    kernel(cdata, cdataA, numBins, params);
 
-        // Reconstruct the complex number with the blended magnitude and phase
-        cdata[i] = std::polar(blendedMagnitude, phase);
+    // Smoothing across hops takes the edge off the frame-to-frame jitter of
+    // the morph, which is worst at small frame sizes.
+    auto smoothing = SpectralSmoother::makeParams(settings.smoothAttack, settings.smoothRelease, settings.phaseSmoothing, 1000.0 * hopSize / sampleRate);
+    if (SpectralSmoother::isActive(smoothing)) {
+        smoother.process(cdata, numBins, smoothing);
+    }
+    else {
+        smoother.reset();
     }
 }
 
-// helpers
-std::vector<float> FFTProcessor::linspace(float start, float end, int numPoints) {
-    std::vector<float> result(numPoints);
-    if (numPoints == 1) {
-        result[0] = start;
-        return result;
+void FFTProcessor::weightedMorphMagnitude(std::complex<float>* cdata, const float* const* auxSpectra, int numBins, ChainSettings settings)
+{
+    // The weights are a point in the simplex spanned by the main input and
+    // the connected sidechain buses. Unconnected buses drop out.
+    float weights[maxAuxSources + 1] = { settings.mainWeight, settings.auxWeight1, settings.auxWeight2, settings.auxWeight3 };
+    static_assert(maxAuxSources == 3, "one weight per sidechain bus");
+
+    float totalWeight = weights[0];
+    for (int source = 0; source < maxAuxSources; ++source) {
+        if (auxSpectra[source] == nullptr) {
+            weights[source + 1] = 0.0f;
+        }
+        totalWeight += weights[source + 1];
     }
 
-    float step = (end - start) / (numPoints - 1);
+    if (totalWeight <= 0.0f) {
+        return;
+    }
 
-    for (int i = 0; i < numPoints; ++i) {
-        result[i] = start + step * i;
+    float* magnitudes = morphMagnitudes.data();
+
+    // Magnitudes are a weighted mean and phases a weighted circular mean, so
+    // every source is reduced into a running magnitude sum and a sum of
+    // weighted unit phasors, one streaming pass per source. The phasor sum
+    // accumulates in cdata, which holds the main input until its own pass.
+    auto accumulate = [&](const std::complex<float>* source, float weight, bool first) {
+        for (int i = 0; i < numBins; ++i) {
+            float re = source[i].real(), im = source[i].imag();
+            float magnitude = std::sqrt(re * re + im * im);
+            float scale = magnitude > 0.0f ? weight / magnitude : 0.0f;
+
+            float sumMagnitude = weight * magnitude;
+            std::complex<float> sumPhasor(re * scale, im * scale);
+            if (!first) {
+                sumMagnitude += magnitudes[i];
+                sumPhasor += cdata[i];
+            }
+            magnitudes[i] = sumMagnitude;
+            cdata[i] = sumPhasor;
+        }
+    };
+
+    accumulate(cdata, weights[0] / totalWeight, true);
+
+    for (int source = 0; source < maxAuxSources; ++source) {
+        if (weights[source + 1] > 0.0f) {
+            accumulate(reinterpret_cast<const std::complex<float>*>(auxSpectra[source]), weights[source + 1] / totalWeight, false);
+        }
     }
 
-    return result;
+    // Put the magnitude back on the mean phasor. Where the phasors cancel
+    // out, the bin gets phase 0. The phase modes still run afterwards;
+    // Preserve Main In keeps this blended phase.
+    for (int i = 0; i < numBins; ++i) {
+        float re = cdata[i].real(), im = cdata[i].imag();
+        float length = std::sqrt(re * re + im * im);
+        float scale = length > 0.0f ? magnitudes[i] / length : 0.0f;
+        cdata[i] = length > 0.0f ? std::complex<float>(re * scale, im * scale)
+                                 : std::complex<float>(magnitudes[i], 0.0f);
+    }
 }
 
 
+
@@ -1,6 +1,13 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "AuxAnalyzer.h"
+#include "ZeroPaddedFFT.h"
+#include "SpectralWorker.h"
+#include "STFTWindow.h"
+#include "MorphCurve.h"
+#include "AlignmentEstimator.h"
+#include "SpectralSmoother.h"
 
 /**
   STFT analysis and resynthesis of audio data.
@@ -10,10 +17,26 @@
 struct ChainSettings {
     float bypassed{ 0 };
     float morphFactor{ 0.5 };
+    float mainWeight{ 0.5 };    // weightedMorph: weights of the main input
+    float auxWeight1{ 0.5 };    // and each sidechain bus, normalised to sum
+    float auxWeight2{ 0 };      // to one over the buses that are connected
+    float auxWeight3{ 0 };
     float formantShiftFactor{ 0 };
     float magProcessing{ 0 };
     float phaseProcessing{ 0 };
     float invertPhase{ 0 };
+    float sidechainGroup{ 0 };
+    float zeroPadding{ 0 };     // log2 of the analysis zero-padding factor
+    float window{ 0 };          // windowFamily
+    float overlap{ 2 };         // log2 of the number of hops per frame
+    float adaptiveFrame{ 0 };   // scale the frame with the sample rate
+    float alignment{ 0 };       // alignmentMode
+    float smoothAttack{ 0 };    // per-bin magnitude attack and release, in ms
+    float smoothRelease{ 0 };
+    float phaseSmoothing{ 0 };  // 0 to 1
+    float hopStagger{ 0 };
+    float pipelined{ 0 };
+    float measureCallbacks{ 0 };
 };
 
 enum magProcessing
@@ -23,7 +46,8 @@ enum magProcessing
     multiply,           // 2
     divide,             // 3
     linearBlend,        // 4
-    allPass             // 5
+    allPass,            // 5
+    weightedMorph       // 6
 };
 
 enum phaseProcessing
@@ -36,65 +60,277 @@ enum phaseProcessing
     preserveAuxIn,       // 5
 };
 
+class SpectralFrameCache;
+class SignalCapture;
+
 class FFTProcessor
 {
 public:
     FFTProcessor();
+    ~FFTProcessor();
+
+    // Sidechain buses a frame can be morphed against. The first is the aux
+    // input every magnitude mode reads; weightedMorph reads all of them.
+    static constexpr int maxAuxSources = 3;
+    using AuxSources = std::array<AuxAnalyzer*, maxAuxSources>;
 
-    int getLatencyInSamples() const { return fftSize; }
+    int getLatencyInSamples() const { return fftSize + (pipeline != nullptr ? hopSize : 0); }
+    int getFFTOrder() const { return fftOrder; }
+    int getHopSize() const { return hopSize; }
 
     void reset();
+
+    // Resizes the frame to 2^order points, keeping the window and overlap.
+    // The hop and latency scale with it. Allocates, so call from the
+    // message thread while not processing, then reset().
+    void setFFTOrder(int newOrder);
+
+    // Only used to turn the smoothing times into hops.
+    void setSampleRate(double newSampleRate) { sampleRate = newSampleRate; }
+
+    // Selects the analysis/synthesis window and the number of hops per frame
+    // (2, 4 or 8). Fewer hops mean fewer FFTs per second; the synthesis
+    // window keeps the reconstruction gain correct for any combination.
+    // Call from the message thread while not processing, then reset().
+    void setWindow(windowFamily family, int newOverlap);
+
+    // Delays this processor's hops by `offset` samples (0 to hopSize - 1)
+    // relative to an unstaggered one. Latency is unaffected. Takes effect
+    // immediately, without clearing the FIFOs.
+    void setHopOffset(int offset);
+
+    // Pipelined mode hands each hop's frame to the shared SpectralWorker and
+    // overlap-adds the result one hop later, adding hopSize to the latency.
+    // Call from the message thread while not processing, then reset().
+    void setPipelined(bool shouldBePipelined);
+    bool isPipelined() const { return pipeline != nullptr; }
+
+    // In real time, a pipelined frame the worker hasn't finished by the
+    // next hop is replaced by the last one rather than waited for. Offline
+    // renders have no deadline, so they wait and always match the
+    // unpipelined output exactly. Call from the message thread.
+    void setNonRealtime(bool isNonRealtime) { nonRealtime = isNonRealtime; }
+
+    // Replaces the per-bin curve used by the linearBlend magnitude mode.
+    // Called from the message thread; the table is rasterised here and
+    // picked up by the audio thread at the start of its next frame.
+    void setMorphCurve(const MorphCurve& curve);
+
+    // Hands every processed spectrum to `capture` as `channel`. Call from the
+    // message thread while not processing; the capture must outlive this.
+    void setCapture(SignalCapture* newCapture, int channel);
+
+    // While `alignment` is on, the delay that would line the first aux
+    // source up with this channel's input, for the owner to apply with
+    // AuxAnalyzer::setDelay(). Safe to call from the audio thread.
+    float getAlignmentDelay() const { return aligner.getDelay(); }
+    bool isAlignmentLocked() const { return aligner.isLocked(); }
+
+    // Called by SpectralWorker to run the frames this processor has queued.
+    void runPendingJobs();
+
     float processSample(float sample, float sampleA, ChainSettings settings);
     void processBlock(float* data, float* dataA, int numSamples, ChainSettings settings);
 
+    // Same as above, but takes the aux spectrum from a (possibly shared)
+    // AuxAnalyzer that has already been fed the current aux sample. Pass
+    // nullptr when there is no aux input; the aux spectrum is then silence.
+    float processSample(float sample, AuxAnalyzer* aux, ChainSettings settings);
+
+    // Same as above, with one analyser per sidechain bus (nullptr for a bus
+    // that isn't connected). Sources other than the first are only analysed
+    // in weightedMorph mode, and then in pairs, two to an FFT.
+    float processSample(float sample, const AuxSources& aux, ChainSettings settings);
+
+    // Switching `bypassed` on crossfades to the input, delayed by the latency,
+    // over one hop and then stops running frames. Switching it off runs
+    // frames for a full latency before crossfading back, so the
+    // output FIFO is complete again by the time it is heard.
+    bool isBypassed() const { return bypassState == bypassed; }
+
+    // Once isBypassed(), whole blocks can be passed through here instead of
+    // processSample(): the input is copied into the history and the delayed
+    // input copied back out, with no per-sample work.
+    void processBypassedBlock(float* data, int numSamples);
+
+    // Offline: resynthesises numSamples of output from pre-analysed frames,
+    // skipping both forward FFTs. Matches processSample() fed the same
+    // inputs, at the cache's zero-padding factor. Returns false, with the
+    // output cleared, if the cache's frame size, hop or window aren't this
+    // processor's.
+    bool renderFromCache(const SpectralFrameCache& cache, float* output, int numSamples, ChainSettings settings);
+
 private:
 
-    void processFrame(ChainSettings settings);
-    void processSpectrum(float* data, float* dataA, int numBins, ChainSettings settings);
+    // Drops every queued frame. The abandon version leaves a frame the
+    // worker is part-way through to finish on its own, so it's safe on the
+    // audio thread; the cancel version waits for it.
+    void abandonPendingJobs();
+    void cancelPendingJobs();
+
+    // Swaps in a table passed to setMorphCurve(), if there is one.
+    void updateMorphTable();
+
+    void updateBypassState(bool shouldBypass);
+    float mixBypass(float wet, float dry);
+    void enterBypassed();
+
+    // Two-part copies into and out of the input history, wrapping at its end.
+    void copyToHistory(const float* source, int start, int numSamples);
+    void copyFromHistory(float* dest, int start, int numSamples) const;
+    void copyInputFrame(float* dest) const;
+
+    void processFrame(const AuxSources& aux, ChainSettings settings);
+    void processFramePipelined(const AuxSources& aux, ChainSettings settings);
+
+    // Number of sources the frame's magnitude mode reads.
+    static int getNumAuxSources(ChainSettings settings) { return (int) settings.magProcessing == weightedMorph ? maxAuxSources : 1; }
 
-    // Phase Processing Functions
-    void averagePhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void linearPhase(std::complex<float>* cdata, int numBins, ChainSettings settings);
-    void linearNaturalPhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void smoothStepPhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void preserveAuxInPhase(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void invertPhase(std::complex<float>* cdata, int numBins, ChainSettings settings);
+    // Windows, transforms, processes and resynthesises one frame in place.
+    // auxSpectra holds maxAuxSources spectra, nullptr where there's no input.
+    // auxDelay is the delay the first of them was analysed with.
+    void transformFrame(float* data, const float* const* auxSpectra, float auxDelay, int padFactor, ChainSettings settings);
+    void overlapAdd(const float* frame);
+    void processSpectrum(float* data, const float* const* auxSpectra, int numBins, ChainSettings settings);
 
-    std::vector<float> linspace(float start, float end, int numPoints); // helper
+    // LoomStress --spectrum times processSpectrum() on its own.
+    friend struct SpectralBenchmark;
 
-    // Magnitude Processing Functions
-    void addAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void subtractAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void multiplyAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void divideAverageMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
-    void linearBlendMagnitude(std::complex<float>* cdata, std::complex<float>* cdataA, int numBins, ChainSettings settings);
+    // The modes that read every aux source run before the kernel.
+    void weightedMorphMagnitude(std::complex<float>* cdata, const float* const* auxSpectra, int numBins, ChainSettings settings);
 
 
-    // The FFT has 2^order points and fftSize/2 + 1 bins.
-    static constexpr int fftOrder = 10;
-    static constexpr int fftSize = 1 << fftOrder;      // 1024 samples
-    static constexpr int numBins = fftSize / 2 + 1;    // 513 bins
-    static constexpr int overlap = 4;                  // 75% overlap
-    static constexpr int hopSize = fftSize / overlap;  // 256 samples
+    // Floats in a spectrum at the largest zero-padding factor.
+    int getMaxSpectrumSize() const { return fftSize * ZeroPaddedFFT::maxPadFactor + 2; }
 
-    // Gain correction for using Hann window with 75% overlap.
-    static constexpr float windowCorrection = 2.0f / 3.0f;
+    // The FFT has 2^order points and fftSize/2 + 1 bins. The order is
+    // planned from the sample rate by FramePlanner.
+    int fftOrder = 10;
+    int fftSize = 1 << fftOrder;                       // 1024 samples
+    static constexpr int maxOverlap = 8;
 
-    juce::dsp::FFT fft;
-    juce::dsp::WindowingFunction<float> window;
+    int overlap = 4;                                   // 75% overlap
+    int hopSize = fftSize / 4;                         // 256 samples
+
+    // Analysis frames can be zero-padded 2x or 4x for finer bin spacing.
+    // Window and hop stay the same, so latency doesn't change.
+    ZeroPaddedFFT fft;
+    STFTWindow window;
 
     // Counts up until the next hop.
     int count = 0;
+    int hopOffset = 0;
 
-    // Write position in input FIFO and read position in output FIFO.
+    // Read position in output FIFO.
     int pos = 0;
 
+    // The input FIFO keeps two frames of history, so the bypass path can read
+    // the input from a full (pipelined) latency ago.
+    int historySize = 2 * fftSize;
+    int historyMask = historySize - 1;
+    int inputPos = 0;
+
     // Circular buffers for incoming and outgoing audio data.
-    std::array<float, fftSize> inputFifo, inputFifoA;
-    std::array<float, fftSize> outputFifo;
+    std::vector<float> inputFifo;
+    std::vector<float> outputFifo;
+
+    enum BypassState
+    {
+        processing,         // 0
+        fadingOut,          // 1
+        bypassed,           // 2
+        warmingUp,          // 3
+        fadingIn            // 4
+    };
+
+    BypassState bypassState = processing;
+    int fadePosition = 0;
+
+    // The FFT working space. Contains interleaved complex numbers, and is
+    // big enough for the spectrum at the largest zero-padding factor.
+    std::vector<float> fftData;
+
+    // Spectrum used in place of the aux input when none is connected.
+    std::vector<float> silentAux;
+
+    // Weighted magnitude sum for weightedMorph.
+    std::vector<float> morphMagnitudes;
+
+    // Aux analysis for the two-input processSample() and processBlock().
+    AuxAnalyzer localAux;
+
+    // The table in use belongs to the audio thread (and to the worker while
+    // it runs a job). New tables arrive through pendingMorphTable; the one
+    // they replace goes back through retiredMorphTable, and is freed by the
+    // next setMorphCurve() call, so nothing is allocated or freed here.
+    std::unique_ptr<MorphCurve::Table> morphTable;
+
+    // The last curve passed in, rasterised again when the frame size changes.
+    MorphCurve morphCurve;
+    std::atomic<MorphCurve::Table*> pendingMorphTable{ nullptr };
+    std::atomic<MorphCurve::Table*> retiredMorphTable{ nullptr };
+
+    SignalCapture* capture = nullptr;
+    int captureChannel = 0;
+
+    // Fed by transformFrame(), so it runs wherever the frame does.
+    AlignmentEstimator aligner;
+
+    // Runs at the end of processSpectrum(), for the same reason.
+    SpectralSmoother smoother;
+    double sampleRate = 48000.0;
+
+    // A frame handed to the worker. The audio thread takes a queued job back
+    // and runs it itself if the worker hasn't started it by the next hop.
+    struct Job
+    {
+        enum State { idle, queued, running, done };
+
+        std::vector<float> fftData;
+        std::array<std::vector<float>, maxAuxSources> fftDataA;
+        ChainSettings settings;
+        std::array<bool, maxAuxSources> hasAux{};
+        float auxDelay = 0.0f;
+        bool resetSmoother = false;
+        std::atomic<int> state{ idle };
+    };
+
+    struct Pipeline
+    {
+        // The job being collected this hop, the one being queued, and a late
+        // one the worker may still be finishing after it was given up on.
+        Job jobs[3];
+        int pendingJob = -1;
+
+        // Held by whichever thread is running one of this processor's jobs.
+        // Jobs share the FFT, window and smoother, so they can't overlap.
+        std::atomic<bool> busy{ false };
+
+        // The last frame collected, added again in place of a late one.
+        std::vector<float> lastFrame;
+
+        // Job indices from the audio thread to the worker.
+        juce::AbstractFifo queue{ 4 };
+        std::array<int, 4> queueSlots{};
+
+        juce::SharedResourcePointer<SpectralWorker> worker;
+        int workerThread = 0;
+    };
+
+    // Runs a queued job on this thread, unless the job has been taken or
+    // another one is running. Returns true if it ran.
+    bool tryRunJob(Job& job);
+    void runJob(Job& job);
+    void allocateJobs();
+
+    bool nonRealtime = false;
+
+    // Set on the audio thread when the smoother should start afresh. A
+    // pipelined processor hands it to the next job rather than resetting the
+    // smoother while the worker may be using it.
+    bool smootherStale = false;
 
-    // The FFT working space. Contains interleaved complex numbers.
-    std::array<float, fftSize * 2> fftData, fftDataA;
+    std::unique_ptr<Pipeline> pipeline;
 
 
 
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Picks the STFT frame size for a sample rate.
+
+  A fixed 1024-point frame has half the frequency resolution at 96 kHz that
+  it has at 48 kHz, and its hops come twice as often. Scaling the frame with
+  the sample rate keeps the bin spacing in Hz, and (for a given overlap) the
+  hop duration in ms, close to what they are at the reference rate, so a
+  session sounds the same and runs the same number of frames per second at
+  any rate. Frames are powers of two, so both are only held to within a
+  factor of sqrt(2).
+
+  The latency in samples grows with the frame, but stays about the same in ms.
+ */
+class FramePlanner
+{
+public:
+    // The frame size the plugin was voiced with: 1024 points at 48 kHz,
+    // about 47 Hz per bin and 5.3 ms per hop at 75% overlap.
+    static constexpr double referenceSampleRate = 48000.0;
+    static constexpr int referenceOrder = 10;
+
+    // 256 to 4096 points covers 12 kHz to 192 kHz. Beyond that the frames
+    // stop growing rather than taking ever more memory and latency.
+    static constexpr int minOrder = 8;
+    static constexpr int maxOrder = 12;
+
+    // FFT order whose bin spacing at sampleRate is nearest the reference's.
+    // With `adaptive` off, or no sample rate yet, the reference order.
+    static int getFFTOrder(double sampleRate, bool adaptive)
+    {
+        if (!adaptive || sampleRate <= 0.0) {
+            return referenceOrder;
+        }
+
+        int order = referenceOrder + (int) std::round(std::log2(sampleRate / referenceSampleRate));
+        return juce::jlimit(minOrder, maxOrder, order);
+    }
+};
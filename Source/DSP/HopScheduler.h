@@ -0,0 +1,41 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Hands out hop phase offsets so that FFT frames from different channels and
+  instances don't all land in the same audio callback.
+
+  With a 256-sample hop and a 64-sample host buffer, unstaggered processors
+  do all their FFT work in one callback out of four. Spreading the hop phases
+  flattens that spike without changing latency, which depends only on the
+  FFT size.
+
+  Slots are handed out in bit-reversed order, so the first two users are
+  half a hop apart, the next two a quarter hop from those, and so on.
+
+  Hold it through a juce::SharedResourcePointer so all instances share it.
+ */
+class HopScheduler
+{
+public:
+    static constexpr int numSlots = 8;
+
+    // Next slot in the process-wide rotation.
+    int nextSlot() { return counter.fetch_add(1) % numSlots; }
+
+    // Phase offset of `slot` within a hop, in samples.
+    static int getOffset(int slot, int hopSize)
+    {
+        int reversed = 0;
+        for (int bit = 1, rbit = numSlots / 2; bit < numSlots; bit <<= 1, rbit >>= 1) {
+            if ((slot & bit) != 0) {
+                reversed |= rbit;
+            }
+        }
+        return reversed * hopSize / numSlots;
+    }
+
+private:
+    std::atomic<int> counter{ 0 };
+};
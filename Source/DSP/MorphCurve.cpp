@@ -0,0 +1,64 @@
+#include "MorphCurve.h"
+#include "ZeroPaddedFFT.h"
+
+MorphCurve::MorphCurve() :
+    breakpoints{ { 0.0f, 0.0f }, { 1.0f, 1.0f } }
+{
+}
+
+MorphCurve::MorphCurve(std::vector<Breakpoint> newBreakpoints) :
+    breakpoints(std::move(newBreakpoints))
+{
+    for (auto& point : breakpoints) {
+        point.frequency = juce::jlimit(0.0f, 1.0f, point.frequency);
+        point.morph = juce::jlimit(0.0f, 1.0f, point.morph);
+    }
+
+    std::stable_sort(breakpoints.begin(), breakpoints.end(),
+                     [](const Breakpoint& a, const Breakpoint& b) { return a.frequency < b.frequency; });
+
+    if (breakpoints.empty()) {
+        breakpoints.push_back({ 0.0f, 0.5f });
+    }
+}
+
+float MorphCurve::getValue(float frequency) const
+{
+    if (frequency <= breakpoints.front().frequency) {
+        return breakpoints.front().morph;
+    }
+
+    for (size_t i = 1; i < breakpoints.size(); ++i) {
+        const auto& left = breakpoints[i - 1];
+        const auto& right = breakpoints[i];
+
+        if (frequency <= right.frequency) {
+            const float width = right.frequency - left.frequency;
+            if (width <= 0.0f) {
+                return right.morph;
+            }
+            return left.morph + (right.morph - left.morph) * (frequency - left.frequency) / width;
+        }
+    }
+
+    return breakpoints.back().morph;
+}
+
+std::unique_ptr<MorphCurve::Table> MorphCurve::createTable(int fftSize) const
+{
+    static_assert(ZeroPaddedFFT::maxPadFactor == 4, "one table per padding factor: 1, 2 and 4");
+
+    auto table = std::make_unique<Table>();
+
+    for (int padOrder = 0; padOrder < (int) table->gains.size(); ++padOrder) {
+        const int numBins = ZeroPaddedFFT::getNumBins(fftSize, 1 << padOrder);
+        auto& gains = table->gains[padOrder];
+        gains.resize(numBins);
+
+        for (int i = 0; i < numBins; ++i) {
+            gains[i] = getValue((float) i / (numBins - 1));
+        }
+    }
+
+    return table;
+}
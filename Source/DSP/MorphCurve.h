@@ -0,0 +1,54 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Frequency-dependent morph amount, drawn as a piecewise-linear curve.
+
+  Breakpoints are edited on the message thread. createTable() rasterises the
+  curve to one gain per bin, for every zero-padding factor, so the audio
+  thread only has to look values up. The default curve is the 0 to 1 ramp
+  that linearBlend used to compute every frame.
+ */
+class MorphCurve
+{
+public:
+    struct Breakpoint
+    {
+        float frequency;    // 0 (DC) to 1 (Nyquist)
+        float morph;        // 0 keeps the main input, 1 takes the aux input
+    };
+
+    // Per-bin gains, built off the audio thread and handed to FFTProcessor.
+    struct Table
+    {
+        // Returns the gains for a spectrum with numBins bins.
+        const float* getGains(int numBins) const
+        {
+            for (auto& table : gains) {
+                if ((int) table.size() == numBins) {
+                    return table.data();
+                }
+            }
+            jassertfalse;
+            return gains[0].data();
+        }
+
+        // Indexed by log2 of the zero-padding factor.
+        std::array<std::vector<float>, 3> gains;
+    };
+
+    MorphCurve();
+    explicit MorphCurve(std::vector<Breakpoint> breakpoints);
+
+    const std::vector<Breakpoint>& getBreakpoints() const { return breakpoints; }
+
+    // Linear interpolation between breakpoints, flat beyond the first and last.
+    float getValue(float frequency) const;
+
+    std::unique_ptr<Table> createTable(int fftSize) const;
+
+private:
+    // Sorted by frequency.
+    std::vector<Breakpoint> breakpoints;
+};
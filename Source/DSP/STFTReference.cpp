@@ -0,0 +1,147 @@
+#include "STFTReference.h"
+
+void STFTReference::fillStimulus(float* main, float* aux, int numSamples, double sampleRate, int seed)
+{
+    // A fixed LCG rather than juce::Random, so the stimulus, and the golden
+    // files rendered from it, can't change with the JUCE version.
+    juce::uint32 state = (juce::uint32) seed;
+    auto nextNoise = [&state]() {
+        state = state * 1664525u + 1013904223u;
+        return (float) (state >> 8) / 16777216.0f * 2.0f - 1.0f;
+    };
+
+    const float twoPi = juce::MathConstants<float>::twoPi;
+
+    for (int i = 0; i < numSamples; ++i) {
+        float t = (float) (i / sampleRate);
+
+        main[i] = 0.5f * std::sin(twoPi * 220.0f * t)
+                + 0.2f * std::sin(twoPi * 1375.0f * t)
+                + 0.05f * nextNoise();
+
+        aux[i] = 0.4f * std::sin(twoPi * 330.0f * t)
+               + 0.2f * std::sin(twoPi * 2490.0f * t)
+               + 0.05f * nextNoise();
+    }
+}
+
+void STFTReference::render(const float* main, const float* aux, float* out, int numSamples, ChainSettings settings)
+{
+    auto processor = std::make_unique<FFTProcessor>();
+    processor->setWindow((windowFamily) (int) settings.window, 1 << (int) settings.overlap);
+    processor->setPipelined(settings.pipelined > 0.5f);
+    processor->setNonRealtime(true);
+    processor->reset();
+
+    for (int i = 0; i < numSamples; ++i) {
+        out[i] = processor->processSample(main[i], aux[i], settings);
+    }
+}
+
+std::vector<ChainSettings> STFTReference::getAllModeSettings(float morphFactor)
+{
+    std::vector<ChainSettings> result;
+
+    for (int mag = magProcessing::addM; mag <= magProcessing::weightedMorph; ++mag) {
+        for (int phase = phaseProcessing::addP; phase <= phaseProcessing::preserveAuxIn; ++phase) {
+            for (int invert = 0; invert < 2; ++invert) {
+                ChainSettings settings;
+                settings.morphFactor = morphFactor;
+                settings.magProcessing = (float) mag;
+                settings.phaseProcessing = (float) phase;
+                settings.invertPhase = (float) invert;
+                result.push_back(settings);
+            }
+        }
+    }
+
+    return result;
+}
+
+STFTAccuracyReport STFTReference::compare(const float* reference, const float* test, int numSamples, STFTTolerance tolerance)
+{
+    STFTAccuracyReport report;
+    report.withinTolerance = true;
+
+    double signalPower = 0.0;
+    double errorPower = 0.0;
+    float peak = 0.0f;
+
+    for (int i = 0; i < numSamples; ++i) {
+        peak = std::max(peak, std::abs(reference[i]));
+    }
+
+    for (int i = 0; i < numSamples; ++i) {
+        float error = std::abs(test[i] - reference[i]);
+        juce::int64 ulps = ulpDistance(reference[i], test[i]);
+
+        signalPower += (double) reference[i] * reference[i];
+        errorPower += (double) error * error;
+        report.maxAbsError = std::max(report.maxAbsError, error);
+        report.maxUlps = std::max(report.maxUlps, ulps);
+
+        double errorDb = juce::Decibels::gainToDecibels((double) error / std::max(peak, 1e-30f), -300.0);
+        if (ulps > tolerance.maxUlps && errorDb > tolerance.maxErrorDb) {
+            report.withinTolerance = false;
+        }
+    }
+
+    report.maxErrorDb = juce::Decibels::gainToDecibels((double) report.maxAbsError / std::max(peak, 1e-30f), -300.0);
+    report.snrDb = errorPower > 0.0 ? 10.0 * std::log10(signalPower / errorPower) : 300.0;
+
+    return report;
+}
+
+STFTAccuracyReport STFTReference::checkReconstruction(const float* main, int numSamples, STFTTolerance tolerance,
+                                                      windowFamily family, int overlap)
+{
+    ChainSettings settings;
+    settings.magProcessing = magProcessing::allPass;
+    settings.phaseProcessing = phaseProcessing::preserveMainIn;
+
+    auto processor = std::make_unique<FFTProcessor>();
+    processor->setWindow(family, overlap);
+    processor->reset();
+
+    const int latency = processor->getLatencyInSamples();
+    std::vector<float> out(numSamples);
+
+    for (int i = 0; i < numSamples; ++i) {
+        out[i] = processor->processSample(main[i], 0.0f, settings);
+    }
+
+    if (numSamples <= latency) {
+        return {};
+    }
+
+    return compare(main, out.data() + latency, numSamples - latency, tolerance);
+}
+
+bool STFTReference::writeGolden(const juce::File& file, const float* data, int numSamples)
+{
+    return file.replaceWithData(data, numSamples * sizeof(float));
+}
+
+bool STFTReference::readGolden(const juce::File& file, std::vector<float>& data)
+{
+    juce::MemoryBlock block;
+    if (!file.loadFileAsData(block)) {
+        return false;
+    }
+
+    data.resize(block.getSize() / sizeof(float));
+    std::memcpy(data.data(), block.getData(), data.size() * sizeof(float));
+    return true;
+}
+
+juce::int64 STFTReference::ulpDistance(float a, float b)
+{
+    // Map the float bit patterns onto a monotonic integer line.
+    auto toOrdered = [](float f) {
+        juce::int32 bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return bits < 0 ? (juce::int64) std::numeric_limits<juce::int32>::min() - bits : (juce::int64) bits;
+    };
+
+    return std::abs(toOrdered(a) - toOrdered(b));
+}
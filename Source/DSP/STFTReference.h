@@ -0,0 +1,58 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "FFTProcessor.h"
+
+/**
+  Deterministic reference renders and accuracy metrics for FFTProcessor.
+
+  Renders fixed main/aux stimuli through a fresh FFTProcessor and compares
+  the result against a stored golden render, so a faster path can be shown
+  to match the reference path within a ULP or dB tolerance.
+
+  Only built into the LoomTests runner (Tools/LoomTests), not the plugin.
+ */
+struct STFTAccuracyReport
+{
+    double snrDb = 0.0;             // reference power over error power
+    double maxErrorDb = 0.0;        // worst sample error, relative to reference peak
+    float maxAbsError = 0.0f;
+    juce::int64 maxUlps = 0;
+    bool withinTolerance = false;
+};
+
+struct STFTTolerance
+{
+    juce::int64 maxUlps = 4096;
+    double maxErrorDb = -100.0;     // a sample passes if it is within either bound
+};
+
+class STFTReference
+{
+public:
+    // Fills main and aux with a fixed mix of tones and seeded noise.
+    static void fillStimulus(float* main, float* aux, int numSamples, double sampleRate, int seed = 1);
+
+    // Renders through a freshly reset FFTProcessor, with the window, overlap
+    // and pipelining from `settings` applied as prepareToPlay would for an
+    // offline render.
+    static void render(const float* main, const float* aux, float* out, int numSamples, ChainSettings settings);
+
+    // Every magProcessing x phaseProcessing x invertPhase combination, in
+    // that nesting order.
+    static std::vector<ChainSettings> getAllModeSettings(float morphFactor = 0.3f);
+
+    static STFTAccuracyReport compare(const float* reference, const float* test, int numSamples, STFTTolerance tolerance);
+
+    // Renders allPass/preserveMainIn with bypass off and compares the output
+    // against the input delayed by the reported latency.
+    static STFTAccuracyReport checkReconstruction(const float* main, int numSamples, STFTTolerance tolerance,
+                                                  windowFamily family = hannWindow, int overlap = 4);
+
+    // Golden files are raw 32-bit floats.
+    static bool writeGolden(const juce::File& file, const float* data, int numSamples);
+    static bool readGolden(const juce::File& file, std::vector<float>& data);
+
+    // Distance between two floats in units in the last place.
+    static juce::int64 ulpDistance(float a, float b);
+};
@@ -0,0 +1,86 @@
+#include "STFTWindow.h"
+
+// Zeroth-order modified Bessel function of the first kind, for Kaiser.
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 50; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+STFTWindow::STFTWindow()
+{
+}
+
+void STFTWindow::prepare(windowFamily newFamily, int fftSize, int overlap)
+{
+    family = newFamily;
+    analysisTable.resize(fftSize);
+
+    // Periodic windows: the period is fftSize, not fftSize - 1, so that
+    // shifted copies tile without a doubled sample at the seams.
+    const double twoPi = juce::MathConstants<double>::twoPi;
+
+    for (int i = 0; i < fftSize; ++i) {
+        const double phase = twoPi * i / fftSize;
+        double value = 0.0;
+
+        switch (family)
+        {
+        case hannWindow:
+            value = 0.5 - 0.5 * std::cos(phase);
+            break;
+        case sqrtHannWindow:
+            value = std::sqrt(0.5 - 0.5 * std::cos(phase));
+            break;
+        case blackmanHarrisWindow:
+            value = blackmanHarris[0] - blackmanHarris[1] * std::cos(phase)
+                  + blackmanHarris[2] * std::cos(2.0 * phase) - blackmanHarris[3] * std::cos(3.0 * phase);
+            break;
+        case kaiserWindow: {
+            const double x = 2.0 * i / fftSize - 1.0;
+            value = besselI0(kaiserBeta * std::sqrt(1.0 - x * x)) / besselI0(kaiserBeta);
+            break;
+        }
+        }
+
+        analysisTable[i] = (float) value;
+    }
+
+    if (overlap <= 0) {
+        synthesisTable.clear();
+        return;
+    }
+
+    jassert(fftSize % overlap == 0);
+    const int hopSize = fftSize / overlap;
+
+    // Reciprocal of the overlap-added squared window at each position in a hop.
+    std::vector<float> normalisation(hopSize);
+
+    const float constantGain = getConstantOverlapGain(family, overlap);
+    if (constantGain > 0.0f) {
+        std::fill(normalisation.begin(), normalisation.end(), 1.0f / constantGain);
+    }
+    else {
+        for (int i = 0; i < hopSize; ++i) {
+            double sum = 0.0;
+            for (int j = i; j < fftSize; j += hopSize) {
+                sum += (double) analysisTable[j] * analysisTable[j];
+            }
+            normalisation[i] = sum > 1e-9 ? (float) (1.0 / sum) : 0.0f;
+        }
+    }
+
+    synthesisTable.resize(fftSize);
+    for (int i = 0; i < fftSize; ++i) {
+        synthesisTable[i] = analysisTable[i] * normalisation[i % hopSize];
+    }
+}
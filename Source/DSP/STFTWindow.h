@@ -0,0 +1,85 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+enum windowFamily
+{
+    hannWindow,             // 0
+    sqrtHannWindow,         // 1
+    blackmanHarrisWindow,   // 2
+    kaiserWindow            // 3
+};
+
+/**
+  Periodic analysis/synthesis window with overlap-add normalisation.
+
+  The same window is applied before the forward FFT and after the inverse,
+  so the overlap-added output is scaled by the sum of the squared window
+  over all overlapping hops. The synthesis table folds in the reciprocal of
+  that sum, so reconstruction gain is exact for any family and overlap.
+
+  For cosine-sum windows whose squared window is COLA at the chosen overlap,
+  the sum is a known constant, computed at compile time by
+  getConstantOverlapGain(). Other combinations, like Kaiser or
+  Blackman-Harris at 4x overlap, get a per-sample table built in prepare().
+ */
+class STFTWindow
+{
+public:
+    STFTWindow();
+
+    // Builds the tables. With overlap 0 only the analysis table is built.
+    void prepare(windowFamily family, int fftSize, int overlap = 0);
+
+    windowFamily getFamily() const { return family; }
+
+    void applyAnalysis(float* data) const
+    {
+        juce::FloatVectorOperations::multiply(data, analysisTable.data(), (int) analysisTable.size());
+    }
+
+    // Window and overlap-add normalisation in one multiply.
+    void applySynthesis(float* data) const
+    {
+        juce::FloatVectorOperations::multiply(data, synthesisTable.data(), (int) synthesisTable.size());
+    }
+
+    // Sum of the squared window over `overlap` evenly spaced hops, if it is the
+    // same for every sample, or 0 if it isn't.
+    static constexpr float getConstantOverlapGain(windowFamily family, int overlap)
+    {
+        // Cosine-series coefficients of the *squared* window. Summing over
+        // `overlap` hops cancels every harmonic that isn't a multiple of
+        // `overlap`, leaving overlap * c0 if no harmonic survives.
+        switch (family)
+        {
+        case hannWindow:
+            return overlap > 2 ? overlap * 0.375f : 0.0f;
+        case sqrtHannWindow:
+            return overlap > 1 ? overlap * 0.5f : 0.0f;
+        case blackmanHarrisWindow:
+            return overlap > 6 ? overlap * blackmanHarrisSquaredMean : 0.0f;
+        case kaiserWindow:
+            return 0.0f;
+        }
+        return 0.0f;
+    }
+
+private:
+    // 4-term Blackman-Harris, and the mean of its square.
+    static constexpr float blackmanHarris[4] = { 0.35875f, 0.48829f, 0.14128f, 0.01168f };
+    static constexpr float blackmanHarrisSquaredMean = blackmanHarris[0] * blackmanHarris[0]
+        + 0.5f * (blackmanHarris[1] * blackmanHarris[1] + blackmanHarris[2] * blackmanHarris[2] + blackmanHarris[3] * blackmanHarris[3]);
+
+    static constexpr float kaiserBeta = 8.0f;
+
+    windowFamily family = hannWindow;
+
+    std::vector<float> analysisTable;
+    std::vector<float> synthesisTable;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(STFTWindow)
+};
+
+// Hann at 75% overlap, the default, is scaled by 2/3.
+static_assert(STFTWindow::getConstantOverlapGain(hannWindow, 4) == 1.5f, "Hann at 75% overlap should sum to 1.5");
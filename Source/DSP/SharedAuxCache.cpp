@@ -0,0 +1,68 @@
+#include "SharedAuxCache.h"
+
+SharedAuxCache::SharedAuxCache()
+{
+    for (auto& slot : slots) {
+        slot.spectrum.assign(maxSpectrumSize, 0.0f);
+    }
+}
+
+SharedAuxCache::Slot& SharedAuxCache::getSlot(int group, int channel)
+{
+    jassert(group >= 1 && group <= numGroups);
+    jassert(channel >= 0 && channel < maxChannels);
+
+    return slots[(group - 1) * maxChannels + channel];
+}
+
+bool SharedAuxCache::fetch(int group, int channel, juce::int64 frame, int fftSize, int size, int window, float* dest)
+{
+    auto& slot = getSlot(group, channel);
+
+    auto version = slot.version.load(std::memory_order_acquire);
+    if ((version & 1) != 0) {
+        return false;
+    }
+
+    if (slot.frame.load(std::memory_order_relaxed) != frame || slot.fftSize.load(std::memory_order_relaxed) != fftSize
+        || slot.size.load(std::memory_order_relaxed) != size || slot.window.load(std::memory_order_relaxed) != window) {
+        return false;
+    }
+
+    std::memcpy(dest, slot.spectrum.data(), size * sizeof(float));
+
+    // If a writer got in while we were copying, what we read may be torn.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.version.load(std::memory_order_relaxed) == version;
+}
+
+void SharedAuxCache::publish(int group, int channel, juce::int64 frame, int fftSize, int size, int window, const float* src)
+{
+    if (size > maxSpectrumSize) {
+        return;
+    }
+
+    auto& slot = getSlot(group, channel);
+
+    // Someone else got there first. An instance with a different frame size
+    // or window still publishes, so the slot follows whoever analysed the hop
+    // last.
+    if (slot.frame.load(std::memory_order_relaxed) == frame && slot.fftSize.load(std::memory_order_relaxed) == fftSize
+        && slot.size.load(std::memory_order_relaxed) == size && slot.window.load(std::memory_order_relaxed) == window) {
+        return;
+    }
+
+    auto version = slot.version.load(std::memory_order_relaxed);
+    if ((version & 1) != 0 || !slot.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(slot.spectrum.data(), src, size * sizeof(float));
+    slot.frame.store(frame, std::memory_order_relaxed);
+    slot.fftSize.store(fftSize, std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.window.store(window, std::memory_order_relaxed);
+
+    slot.version.store(version + 2, std::memory_order_release);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "FramePlanner.h"
+#include "ZeroPaddedFFT.h"
+
+/**
+  Process-wide cache of aux spectra, shared by Loom instances that are
+  sidechained from the same source.
+
+  Instances opt in by picking the same sidechain group. The first instance to
+  analyse a hop publishes its aux spectrum, and the others copy it instead of
+  running their own FFT. Each slot is a seqlock: readers never block, and a
+  read that races a write is simply treated as a miss.
+
+  Hops are matched by timeline position, so instances whose hops don't line
+  up, or that don't know the timeline position, fall back to local analysis.
+
+  Hold it through a juce::SharedResourcePointer.
+ */
+class SharedAuxCache
+{
+public:
+    static constexpr int numGroups = 16;
+    static constexpr int maxChannels = 8;
+
+    // Largest spectrum a slot can hold, in floats: the largest frame
+    // FramePlanner plans, at the largest zero-padding factor. About 64 kB a
+    // slot, 8 MB in all, allocated once per process.
+    static constexpr int maxSpectrumSize = ZeroPaddedFFT::getNumBins(1 << FramePlanner::maxOrder, ZeroPaddedFFT::maxPadFactor) * 2;
+
+    SharedAuxCache();
+
+    // Copies the spectrum of the hop ending at timeline sample `frame` into
+    // dest if it has been published with the same frame size, spectrum size
+    // and window. The spectrum size alone isn't enough: a 2048-point frame
+    // and a 1024-point one padded 2x have the same number of bins. Returns
+    // false if it hasn't, or if it was being overwritten while we read it.
+    bool fetch(int group, int channel, juce::int64 frame, int fftSize, int size, int window, float* dest);
+
+    // Publishes a locally computed spectrum. Gives up without waiting if
+    // another instance is publishing into the same slot.
+    void publish(int group, int channel, juce::int64 frame, int fftSize, int size, int window, const float* src);
+
+private:
+    struct Slot
+    {
+        // Odd while a write is in progress.
+        std::atomic<juce::uint32> version{ 0 };
+        std::atomic<juce::int64> frame{ -1 };
+        std::atomic<int> fftSize{ 0 };
+        std::atomic<int> size{ 0 };
+        std::atomic<int> window{ 0 };
+        std::vector<float> spectrum;
+    };
+
+    Slot& getSlot(int group, int channel);
+
+    // Groups are numbered from 1, group 0 means sharing is off.
+    std::array<Slot, numGroups * maxChannels> slots;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedAuxCache)
+};
@@ -0,0 +1,276 @@
+#include "SpectralFrameCache.h"
+#include "ZeroPaddedFFT.h"
+
+// IEEE 754 half precision, round to nearest even.
+static juce::uint16 floatToHalf(float value)
+{
+    juce::uint32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    juce::uint32 sign = (bits >> 16) & 0x8000;
+    juce::int32 exponent = (juce::int32) ((bits >> 23) & 0xff) - 127 + 15;
+    juce::uint32 mantissa = bits & 0x7fffff;
+
+    if (((bits >> 23) & 0xff) == 0xff) {
+        return (juce::uint16) (sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+    }
+    if (exponent >= 31) {
+        return (juce::uint16) (sign | 0x7c00);
+    }
+    if (exponent <= 0) {
+        // Subnormal, or too small to represent at all.
+        if (exponent < -10) {
+            return (juce::uint16) sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        juce::uint32 half = mantissa >> shift;
+        juce::uint32 remainder = mantissa & ((1u << shift) - 1);
+        juce::uint32 midpoint = 1u << (shift - 1);
+        if (remainder > midpoint || (remainder == midpoint && (half & 1) != 0)) {
+            half += 1;
+        }
+        return (juce::uint16) (sign | half);
+    }
+
+    // A carry out of the mantissa correctly bumps the exponent.
+    juce::uint32 half = sign | ((juce::uint32) exponent << 10) | (mantissa >> 13);
+    juce::uint32 remainder = mantissa & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1) != 0)) {
+        half += 1;
+    }
+    return (juce::uint16) half;
+}
+
+static float halfToFloat(juce::uint16 half)
+{
+    juce::uint32 sign = (juce::uint32) (half & 0x8000) << 16;
+    juce::uint32 exponent = (half >> 10) & 0x1f;
+    juce::uint32 mantissa = half & 0x3ff;
+
+    if (exponent == 0) {
+        float value = std::ldexp((float) mantissa, -24);
+        return sign != 0 ? -value : value;
+    }
+
+    juce::uint32 bits = exponent == 31 ? sign | 0x7f800000 | (mantissa << 13)
+                                       : sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Range of the quantized log magnitude, in dB. Bin magnitudes aren't
+// normalised by the FFT size, so full scale sits well above 0 dB.
+static constexpr float minMagnitudeDb = -140.0f;
+static constexpr float maxMagnitudeDb = 100.0f;
+
+SpectralFrameCache::SpectralFrameCache()
+{
+}
+
+bool SpectralFrameCache::write(const juce::File& file, const float* main, const float* aux, int numSamples,
+                               int fftOrder, int hopSize, int padFactor, Format format,
+                               windowFamily window)
+{
+    const int fftSize = 1 << fftOrder;
+    const int numBins = ZeroPaddedFFT::getNumBins(fftSize, padFactor);
+    const int frameBytes = numBins * getBytesPerBin(format);
+
+    Header header{};
+    std::memcpy(header.magic, "LMSC", 4);
+    header.version = 1;
+    header.fftSize = fftSize;
+    header.hopSize = hopSize;
+    header.padFactor = padFactor;
+    header.numBins = numBins;
+    header.numFrames = numSamples / hopSize;
+    header.numSamples = numSamples;
+    header.format = format;
+    header.window = window;
+
+    juce::FileOutputStream stream(file);
+    if (!stream.openedOk()) {
+        return false;
+    }
+    stream.setPosition(0);
+    stream.truncate();
+    stream.write(&header, sizeof(header));
+
+    // Analyse exactly the frames FFTProcessor would: one per hop, each made of
+    // the last fftSize samples with zeros before the start of the input.
+    ZeroPaddedFFT fft;
+    fft.prepare(fftOrder);
+    STFTWindow analysisWindow;
+    analysisWindow.prepare(window, fftSize);
+
+    std::vector<float> fftData(fftSize * ZeroPaddedFFT::maxPadFactor + 2);
+    std::vector<char> encoded(frameBytes);
+
+    for (int frame = 0; frame < header.numFrames; ++frame) {
+        const int end = (frame + 1) * hopSize;
+        const int start = end - fftSize;
+
+        for (const float* input : { main, aux }) {
+            for (int i = 0; i < fftSize; ++i) {
+                fftData[i] = start + i >= 0 ? input[start + i] : 0.0f;
+            }
+
+            analysisWindow.applyAnalysis(fftData.data());
+            fft.performForward(fftData.data(), padFactor);
+
+            encode(fftData.data(), numBins, format, encoded.data());
+            if (!stream.write(encoded.data(), frameBytes)) {
+                return false;
+            }
+        }
+    }
+
+    stream.flush();
+    return true;
+}
+
+bool SpectralFrameCache::open(const juce::File& file)
+{
+    mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+
+    if (mappedFile->getData() == nullptr || mappedFile->getSize() < sizeof(Header)) {
+        mappedFile.reset();
+        return false;
+    }
+
+    std::memcpy(&header, mappedFile->getData(), sizeof(Header));
+
+    if (std::memcmp(header.magic, "LMSC", 4) != 0 || header.version != 1 || !isValid(header)) {
+        mappedFile.reset();
+        return false;
+    }
+
+    const size_t expectedSize = sizeof(Header) + (size_t) header.numFrames * 2 * header.numBins * getBytesPerBin(header.format);
+    if (mappedFile->getSize() < expectedSize) {
+        mappedFile.reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool SpectralFrameCache::isValid(const Header& header)
+{
+    // Everything readers size their buffers by, and everything
+    // renderFromCache() has to match, has to be something write() makes.
+    const bool padFactorValid = header.padFactor == 1 || header.padFactor == 2 || header.padFactor == 4;
+    const bool fftSizeValid = header.fftSize >= 2 && header.fftSize <= (1 << 16) && juce::isPowerOfTwo(header.fftSize);
+
+    return padFactorValid && fftSizeValid
+        && header.numBins == ZeroPaddedFFT::getNumBins(header.fftSize, header.padFactor)
+        && header.hopSize > 0 && header.hopSize <= header.fftSize
+        && header.numSamples >= 0 && header.numFrames == header.numSamples / header.hopSize
+        && header.format >= float32 && header.format <= quantizedPolar
+        && header.window >= hannWindow && header.window <= kaiserWindow;
+}
+
+const char* SpectralFrameCache::getFrameData(int index, bool aux) const
+{
+    jassert(isOpen() && index >= 0 && index < header.numFrames);
+
+    const size_t frameBytes = (size_t) header.numBins * getBytesPerBin(header.format);
+    const size_t offset = sizeof(Header) + ((size_t) index * 2 + (aux ? 1 : 0)) * frameBytes;
+    return static_cast<const char*>(mappedFile->getData()) + offset;
+}
+
+void SpectralFrameCache::readMainFrame(int index, float* dest) const
+{
+    decode(getFrameData(index, false), header.numBins, header.format, dest);
+}
+
+void SpectralFrameCache::readAuxFrame(int index, float* dest) const
+{
+    decode(getFrameData(index, true), header.numBins, header.format, dest);
+}
+
+const float* SpectralFrameCache::getAuxFrame(int index, float* scratch) const
+{
+    if (header.format == float32) {
+        return reinterpret_cast<const float*>(getFrameData(index, true));
+    }
+
+    readAuxFrame(index, scratch);
+    return scratch;
+}
+
+void SpectralFrameCache::encode(const float* spectrum, int numBins, int format, char* dest)
+{
+    switch (format)
+    {
+    case float32:
+        std::memcpy(dest, spectrum, numBins * 2 * sizeof(float));
+        break;
+
+    case float16:
+    {
+        auto* out = reinterpret_cast<juce::uint16*>(dest);
+        for (int i = 0; i < numBins * 2; ++i) {
+            out[i] = floatToHalf(spectrum[i]);
+        }
+        break;
+    }
+
+    case quantizedPolar:
+    {
+        // [log magnitude, phase] pairs. Magnitude code 0 is exact silence.
+        auto* out = reinterpret_cast<juce::uint16*>(dest);
+        const auto* cdata = reinterpret_cast<const std::complex<float>*>(spectrum);
+        for (int i = 0; i < numBins; ++i) {
+            float magnitude = std::abs(cdata[i]);
+            float db = juce::jlimit(minMagnitudeDb, maxMagnitudeDb, juce::Decibels::gainToDecibels(magnitude, minMagnitudeDb));
+            float normalized = (db - minMagnitudeDb) / (maxMagnitudeDb - minMagnitudeDb);
+            juce::int16 phase = (juce::int16) juce::roundToInt(std::arg(cdata[i]) / juce::MathConstants<float>::pi * 32767.0f);
+
+            out[i * 2] = magnitude > 0.0f ? (juce::uint16) juce::jmax(1, juce::roundToInt(normalized * 65535.0f)) : 0;
+            std::memcpy(&out[i * 2 + 1], &phase, sizeof(phase));
+        }
+        break;
+    }
+    }
+}
+
+void SpectralFrameCache::decode(const char* src, int numBins, int format, float* dest)
+{
+    switch (format)
+    {
+    case float32:
+        std::memcpy(dest, src, numBins * 2 * sizeof(float));
+        break;
+
+    case float16:
+    {
+        const auto* in = reinterpret_cast<const juce::uint16*>(src);
+        for (int i = 0; i < numBins * 2; ++i) {
+            dest[i] = halfToFloat(in[i]);
+        }
+        break;
+    }
+
+    case quantizedPolar:
+    {
+        const auto* in = reinterpret_cast<const juce::uint16*>(src);
+        auto* cdata = reinterpret_cast<std::complex<float>*>(dest);
+        for (int i = 0; i < numBins; ++i) {
+            juce::int16 phase;
+            std::memcpy(&phase, &in[i * 2 + 1], sizeof(phase));
+
+            float db = minMagnitudeDb + (in[i * 2] / 65535.0f) * (maxMagnitudeDb - minMagnitudeDb);
+            float magnitude = in[i * 2] == 0 ? 0.0f : juce::Decibels::decibelsToGain(db, minMagnitudeDb - 1.0f);
+
+            // Codes -32767 and 32767 are both pi. The bin goes back on the
+            // negative real axis, as the DC and Nyquist bins came, so that
+            // std::arg gives pi again rather than whichever of +pi and -pi
+            // sin(pi) rounds to.
+            cdata[i] = std::abs(phase) == 32767 ? std::complex<float>(-magnitude, 0.0f)
+                                                : std::polar(magnitude, phase / 32767.0f * juce::MathConstants<float>::pi);
+        }
+        break;
+    }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "STFTWindow.h"
+
+/**
+  On-disk cache of per-hop main and aux spectra for offline renders.
+
+  When the same main/aux pair is rendered many times with different morph
+  settings, only processSpectrum changes between passes. write() analyses
+  both inputs once, with the same hop timing, window and zero padding as
+  FFTProcessor. Later passes memory-map the file and hand the frames to
+  FFTProcessor::renderFromCache(), which skips the forward transforms.
+
+  Frames can be stored as 32-bit floats (zero-copy reads), 16-bit floats,
+  or as a 16-bit log magnitude plus a 16-bit phase per bin.
+ */
+class SpectralFrameCache
+{
+public:
+    enum Format
+    {
+        float32,            // 0
+        float16,            // 1
+        quantizedPolar      // 2
+    };
+
+    SpectralFrameCache();
+
+    // Analyses main and aux and writes every hop's spectra to `file`.
+    static bool write(const juce::File& file, const float* main, const float* aux, int numSamples,
+                      int fftOrder, int hopSize, int padFactor, Format format,
+                      windowFamily window = hannWindow);
+
+    // Maps a file written by write(). Returns false if it isn't one, or its
+    // header describes frames write() can't have made.
+    bool open(const juce::File& file);
+    bool isOpen() const { return mappedFile != nullptr; }
+
+    int getFFTSize() const { return header.fftSize; }
+    int getHopSize() const { return header.hopSize; }
+    int getPadFactor() const { return header.padFactor; }
+    windowFamily getWindow() const { return (windowFamily) header.window; }
+    int getNumBins() const { return header.numBins; }
+    int getNumFrames() const { return header.numFrames; }
+    int getNumSamples() const { return header.numSamples; }
+
+    // Copies frame `index` as interleaved complex numbers into dest, which
+    // must hold getNumBins() * 2 floats.
+    void readMainFrame(int index, float* dest) const;
+    void readAuxFrame(int index, float* dest) const;
+
+    // Returns the aux spectrum of frame `index` without copying if it is
+    // stored as float32, otherwise decodes it into scratch and returns that.
+    const float* getAuxFrame(int index, float* scratch) const;
+
+private:
+    struct Header
+    {
+        char magic[4];
+        juce::int32 version;
+        juce::int32 fftSize;
+        juce::int32 hopSize;
+        juce::int32 padFactor;
+        juce::int32 numBins;
+        juce::int32 numFrames;
+        juce::int32 numSamples;
+        juce::int32 format;
+        juce::int32 window;
+        juce::int32 reserved[6];
+    };
+
+    static_assert(sizeof(Header) == 64, "frames should start 64-byte aligned");
+
+    static bool isValid(const Header& header);
+
+    static int getBytesPerBin(int format) { return format == float32 ? 8 : 4; }
+
+    static void encode(const float* spectrum, int numBins, int format, char* dest);
+    static void decode(const char* src, int numBins, int format, float* dest);
+
+    const char* getFrameData(int index, bool aux) const;
+
+    Header header{};
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectralFrameCache)
+};
@@ -0,0 +1,154 @@
+#include "SpectralKernels.h"
+#include "FFTProcessor.h"
+
+template <int magMode>
+float SpectralKernels::processMagnitude(float magnitude, float magnitudeA, int bin, const Params& params)
+{
+    const float morphFactor = params.morphFactor;
+
+    if constexpr (magMode == magProcessing::addM) {
+        return (magnitude * morphFactor) + (magnitudeA * (1.0f - morphFactor));
+    }
+    else if constexpr (magMode == magProcessing::subtract) {
+        return std::abs((magnitude * morphFactor) - (magnitudeA * (1.0f - morphFactor)));
+    }
+    else if constexpr (magMode == magProcessing::multiply) {
+        float morphedMagnitude = std::abs((magnitude * morphFactor) * (magnitudeA * (1.0f - morphFactor)));
+
+        float normalizationFactor = std::max(magnitude * magnitudeA, 1.0f);
+        return morphedMagnitude / normalizationFactor;
+    }
+    else if constexpr (magMode == magProcessing::divide) {
+        // Avoid division by zero by clamping magnitudeA to a small positive value
+        float safeMagnitudeA = std::max(magnitudeA * (1.0f - morphFactor), 1e-6f);
+
+        // Clamp to avoid extremely large values, assuming normalized input
+        return std::min((magnitude * morphFactor) / safeMagnitudeA, 1.0f);
+    }
+    else if constexpr (magMode == magProcessing::linearBlend) {
+        // Crossfade with the per-bin amounts from the drawn morph curve
+        return magnitude + params.blendCurve[bin] * (magnitudeA - magnitude);
+    }
+    else {
+        return magnitude;
+    }
+}
+
+template <int phaseMode>
+float SpectralKernels::processPhase(float phase, float phaseA, float linearPhase, const Params& params)
+{
+    const float morphFactor = params.morphFactor;
+
+    if constexpr (phaseMode == phaseProcessing::addP) {
+        return (phase * morphFactor) + (phaseA * (1.0f - morphFactor));
+    }
+    else if constexpr (phaseMode == phaseProcessing::linear) {
+        // Wrap phase to the range [-pi, pi] to avoid discontinuities
+        if (linearPhase > 3.14f) linearPhase -= 2.0f * 3.14f;
+        if (linearPhase < -3.14f) linearPhase += 2.0f * 3.14f;
+        return linearPhase;
+    }
+    else if constexpr (phaseMode == phaseProcessing::linearNatural) {
+        // Blend between the forced linear phase and the average phase
+        float averageMorphedPhase = (phase * morphFactor) + (phaseA * (1.0f - morphFactor));
+        float blendedPhase = (1.0f - morphFactor) * averageMorphedPhase + morphFactor * linearPhase;
+
+        if (blendedPhase > 3.14f) blendedPhase -= 2.0f * 3.14f;
+        if (blendedPhase < -3.14f) blendedPhase += 2.0f * 3.14f;
+        return blendedPhase;
+    }
+    else if constexpr (phaseMode == phaseProcessing::smoothStep) {
+        float blendCurve = 3 * morphFactor * morphFactor - 2 * morphFactor * morphFactor * morphFactor;  // Smoothstep function
+        return blendCurve * phase + (1 - blendCurve) * phaseA;
+    }
+    else if constexpr (phaseMode == phaseProcessing::preserveAuxIn) {
+        return phaseA;
+    }
+    else {
+        return phase;
+    }
+}
+
+template <int magMode, int phaseMode, bool invert>
+void SpectralKernels::process(std::complex<float>* cdata, const std::complex<float>* cdataA, int numBins, const Params& params)
+{
+    constexpr bool readsMagnitudeA = magMode != magProcessing::allPass;
+    constexpr bool keepsPhase = phaseMode == phaseProcessing::preserveMainIn;
+    constexpr bool readsPhase = phaseMode == phaseProcessing::addP
+                             || phaseMode == phaseProcessing::linearNatural
+                             || phaseMode == phaseProcessing::smoothStep;
+    constexpr bool readsPhaseA = readsPhase || phaseMode == phaseProcessing::preserveAuxIn;
+
+    if constexpr (magMode == magProcessing::allPass && keepsPhase && !invert) {
+        return;
+    }
+
+    // The linear phase modes ramp from -3.14 to 3.14 across the bins.
+    const float linearStep = numBins > 1 ? (3.14f - -3.14f) / (numBins - 1) : 0.0f;
+
+    for (int i = 0; i < numBins; ++i) {
+        float re = cdata[i].real(), im = cdata[i].imag();
+        float magnitude = std::sqrt(re * re + im * im);
+
+        float magnitudeA = 0.0f;
+        if constexpr (readsMagnitudeA) {
+            float reA = cdataA[i].real(), imA = cdataA[i].imag();
+            magnitudeA = std::sqrt(reA * reA + imA * imA);
+        }
+
+        float morphedMagnitude = processMagnitude<magMode>(magnitude, magnitudeA, i, params);
+
+        if constexpr (keepsPhase) {
+            // Rescale rather than going through polar form. Inverting the
+            // phase is conjugating. A zero bin has phase 0, as std::arg gives.
+            float scale = magnitude > 0.0f ? morphedMagnitude / magnitude : 0.0f;
+            cdata[i] = magnitude > 0.0f ? std::complex<float>(re * scale, (invert ? -im : im) * scale)
+                                        : std::complex<float>(morphedMagnitude, 0.0f);
+        }
+        else {
+            float phase = readsPhase ? std::atan2(im, re) : 0.0f;
+            float phaseA = readsPhaseA ? std::arg(cdataA[i]) : 0.0f;
+
+            if constexpr (readsPhase && magMode != magProcessing::allPass) {
+                // The magnitude modes have always handed the phase modes a bin
+                // in polar form. A phase of exactly +-pi, as the DC and Nyquist
+                // bins often have, is just beyond pi as a float, so it came
+                // back from that round trip with the other sign. Averaged with
+                // the aux phase that is audible, so it is kept. Any other
+                // phase came back to within rounding.
+                phase = std::abs(phase) == juce::MathConstants<float>::pi ? -phase : phase;
+            }
+
+            float morphedPhase = processPhase<phaseMode>(phase, phaseA, -3.14f + linearStep * i, params);
+            if constexpr (invert) {
+                morphedPhase = -morphedPhase;
+            }
+
+            cdata[i] = std::polar(morphedMagnitude, morphedPhase);
+        }
+    }
+}
+
+static_assert(SpectralKernels::numMagModes == magProcessing::allPass + 1, "one kernel row per magnitude mode");
+static_assert(SpectralKernels::numPhaseModes == phaseProcessing::preserveAuxIn + 1, "one kernel column per phase mode");
+
+template <int... indices>
+constexpr std::array<SpectralKernels::Kernel, sizeof...(indices)> SpectralKernels::makeTable(std::integer_sequence<int, indices...>)
+{
+    // Index = (magMode * numPhaseModes + phaseMode) * 2 + invert
+    return { &process<indices / (numPhaseModes * 2), (indices / 2) % numPhaseModes, (indices % 2) == 1>... };
+}
+
+SpectralKernels::Kernel SpectralKernels::get(int magMode, int phaseMode, bool invert)
+{
+    static constexpr auto table = makeTable(std::make_integer_sequence<int, numMagModes * numPhaseModes * 2>());
+
+    if (magMode == magProcessing::weightedMorph) {
+        magMode = magProcessing::allPass;
+    }
+
+    magMode = juce::jlimit(0, numMagModes - 1, magMode);
+    phaseMode = juce::jlimit(0, numPhaseModes - 1, phaseMode);
+
+    return table[(magMode * numPhaseModes + phaseMode) * 2 + (invert ? 1 : 0)];
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Fused per-bin magnitude and phase processing for FFTProcessor.
+
+  The magnitude mode, phase mode and phase inversion used to be separate
+  passes over the spectrum, each converting every bin to polar form and
+  back. Each combination is now its own instantiation of a single loop that
+  only computes the magnitudes and phases its modes read, and converts back
+  once. Combinations that keep the main input's phase rescale the bin
+  instead, with no atan2 or sincos at all. The output matches the separate
+  passes to float rounding, so a magnitude mode followed by a phase mode
+  that averages phases still reads the phase back from polar form, as the
+  passes did.
+
+  The instantiations are built into a table at compile time, so choosing
+  one when the modes change is an index, not a switch per mode per frame.
+ */
+class SpectralKernels
+{
+public:
+    struct Params
+    {
+        float morphFactor = 0.5f;
+        const float* blendCurve = nullptr;  // linearBlend: one gain per bin
+    };
+
+    using Kernel = void (*)(std::complex<float>* cdata, const std::complex<float>* cdataA, int numBins, const Params& params);
+
+    // magMode and phaseMode are magProcessing and phaseProcessing values.
+    // weightedMorph gets the allPass kernel: its magnitudes and phases are
+    // computed beforehand, from all the sources at once.
+    static Kernel get(int magMode, int phaseMode, bool invert);
+
+    static constexpr int numMagModes = 6;
+    static constexpr int numPhaseModes = 6;
+
+private:
+    template <int magMode>
+    static float processMagnitude(float magnitude, float magnitudeA, int bin, const Params& params);
+
+    template <int phaseMode>
+    static float processPhase(float phase, float phaseA, float linearPhase, const Params& params);
+
+    template <int magMode, int phaseMode, bool invert>
+    static void process(std::complex<float>* cdata, const std::complex<float>* cdataA, int numBins, const Params& params);
+
+    template <int... indices>
+    static constexpr std::array<Kernel, sizeof...(indices)> makeTable(std::integer_sequence<int, indices...>);
+};
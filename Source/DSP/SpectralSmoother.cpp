@@ -0,0 +1,142 @@
+#include "SpectralSmoother.h"
+
+SpectralSmoother::Params SpectralSmoother::makeParams(float attackMs, float releaseMs, float phaseAmount, double hopMs)
+{
+    auto coefficient = [hopMs](float ms) {
+        return ms > 0.0f ? (float) (1.0 - std::exp(-hopMs / ms)) : 1.0f;
+    };
+
+    Params params;
+    params.attack = coefficient(attackMs);
+    params.release = coefficient(releaseMs);
+
+    // A little of the input phase is always kept, so the output can't drift
+    // away from it for good.
+    params.phase = maxPhasePull * juce::jlimit(0.0f, 1.0f, phaseAmount);
+    return params;
+}
+
+void SpectralSmoother::prepare(int maxNumBins)
+{
+    for (auto* state : { &magnitude, &inputRe, &inputIm, &outputRe, &outputIm, &rotationRe, &rotationIm }) {
+        state->assign(maxNumBins, 0.0f);
+    }
+
+    reset();
+}
+
+void SpectralSmoother::reset()
+{
+    primedNumBins = 0;
+    phasePrimed = false;
+}
+
+void SpectralSmoother::prime(const std::complex<float>* cdata, int numBins)
+{
+    for (int i = 0; i < numBins; ++i) {
+        float re = cdata[i].real(), im = cdata[i].imag();
+        float m = std::sqrt(re * re + im * im);
+        float scale = m > 0.0f ? 1.0f / m : 0.0f;
+
+        magnitude[i] = m;
+        inputRe[i] = outputRe[i] = re * scale;
+        inputIm[i] = outputIm[i] = im * scale;
+
+        // No rotation yet, so the first hops follow the input's phase.
+        rotationRe[i] = 0.0f;
+        rotationIm[i] = 0.0f;
+    }
+
+    primedNumBins = numBins;
+    phasePrimed = true;
+}
+
+void SpectralSmoother::process(std::complex<float>* cdata, int numBins, const Params& params)
+{
+    jassert(numBins <= (int) magnitude.size());
+
+    if (numBins != primedNumBins) {
+        prime(cdata, numBins);
+        return;
+    }
+
+    if (params.phase > 0.0f) {
+        if (!phasePrimed) {
+            // The phase state went stale while phase smoothing was off.
+            prime(cdata, numBins);
+            return;
+        }
+        processBins<true>(cdata, numBins, params);
+    }
+    else {
+        phasePrimed = false;
+        processBins<false>(cdata, numBins, params);
+    }
+}
+
+template <bool smoothPhase>
+void SpectralSmoother::processBins(std::complex<float>* cdata, int numBins, const Params& params)
+{
+    // The rotation is tracked faster than the phase is pulled, so full phase
+    // smoothing still follows changes in frequency.
+    const float pull = params.phase;
+    const float track = 1.0f - 0.75f * pull;
+    const float attack = params.attack, release = params.release;
+
+    // None of the arrays overlap, which saves the vectoriser from checking.
+    float* __restrict mag = magnitude.data();
+    float* __restrict inRe = inputRe.data();
+    float* __restrict inIm = inputIm.data();
+    float* __restrict outRe = outputRe.data();
+    float* __restrict outIm = outputIm.data();
+    float* __restrict rotRe = rotationRe.data();
+    float* __restrict rotIm = rotationIm.data();
+    float* __restrict data = reinterpret_cast<float*>(cdata);
+
+    for (int i = 0; i < numBins; ++i) {
+        float re = data[2 * i], im = data[2 * i + 1];
+        float m = std::sqrt(re * re + im * im);
+
+        // Attack when rising, release when falling.
+        float coefficient = m > mag[i] ? attack : release;
+        float smoothed = mag[i] + coefficient * (m - mag[i]);
+        mag[i] = smoothed;
+
+        // Clamped rather than tested, so there's no branch. A zero bin still
+        // comes out as zero.
+        float scale = 1.0f / juce::jmax(m, minMagnitude);
+        float ur = re * scale, ui = im * scale;
+
+        if constexpr (smoothPhase) {
+            // This hop's rotation is the input phasor times the conjugate of
+            // the last one.
+            float dr = ur * inRe[i] + ui * inIm[i];
+            float di = ui * inRe[i] - ur * inIm[i];
+            inRe[i] = ur;
+            inIm[i] = ui;
+
+            rotRe[i] += track * (dr - rotRe[i]);
+            rotIm[i] += track * (di - rotIm[i]);
+
+            // Where the last output phase would be now, blended with the input's.
+            float pr = outRe[i] * rotRe[i] - outIm[i] * rotIm[i];
+            float pi = outRe[i] * rotIm[i] + outIm[i] * rotRe[i];
+            float vr = ur + pull * (pr - ur);
+            float vi = ui + pull * (pi - ui);
+
+            // If they cancel out, fall back to the input phase.
+            float length = std::sqrt(vr * vr + vi * vi);
+            float invLength = 1.0f / juce::jmax(length, minLength);
+            bool valid = length > minLength;
+            ur = valid ? vr * invLength : ur;
+            ui = valid ? vi * invLength : ui;
+            outRe[i] = ur;
+            outIm[i] = ui;
+        }
+
+        // A bin with no phase to go on gets phase 0, as the kernels give it.
+        bool hasPhase = (ur != 0.0f) | (ui != 0.0f);
+        data[2 * i] = hasPhase ? smoothed * ur : smoothed;
+        data[2 * i + 1] = smoothed * ui;
+    }
+}
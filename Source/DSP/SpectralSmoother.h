@@ -0,0 +1,64 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Per-bin temporal smoothing of the processed spectrum, to keep the
+  musical noise of small frames down.
+
+  Each bin's magnitude follows its input with separate attack and release
+  times. Phases can't simply be averaged from hop to hop, since every bin
+  rotates by its own frequency in between, so phase smoothing averages that
+  rotation instead: the output phase is pulled from the input's towards the
+  previous output phase advanced by the smoothed rotation, which keeps
+  partials coherent across hops.
+
+  The state is one contiguous array per quantity, and the whole spectrum is
+  done in one branch-free pass the compiler can vectorise, with no atan2 or
+  sincos.
+ */
+class SpectralSmoother
+{
+public:
+    // Per-hop coefficients, from 0 (hold) to 1 (no smoothing).
+    struct Params
+    {
+        float attack = 1.0f;
+        float release = 1.0f;
+        float phase = 0.0f;     // how far the phase is pulled, up to maxPhasePull
+    };
+
+    // Converts attack and release times in ms to coefficients for hops of
+    // hopMs. A time of zero is no smoothing.
+    static Params makeParams(float attackMs, float releaseMs, float phaseAmount, double hopMs);
+
+    static bool isActive(const Params& params) { return params.attack < 1.0f || params.release < 1.0f || params.phase > 0.0f; }
+
+    void prepare(int maxNumBins);
+
+    // The next spectrum is passed through, and starts the smoothing afresh.
+    void reset();
+
+    void process(std::complex<float>* cdata, int numBins, const Params& params);
+
+private:
+    static constexpr float maxPhasePull = 0.95f;
+    static constexpr float minMagnitude = 1e-30f;
+    static constexpr float minLength = 1e-6f;
+
+    void prime(const std::complex<float>* cdata, int numBins);
+
+    template <bool smoothPhase>
+    void processBins(std::complex<float>* cdata, int numBins, const Params& params);
+
+    // Followed magnitude, last input and output phases as unit phasors, and
+    // the smoothed rotation per hop, one element per bin.
+    std::vector<float> magnitude;
+    std::vector<float> inputRe, inputIm;
+    std::vector<float> outputRe, outputIm;
+    std::vector<float> rotationRe, rotationIm;
+
+    // Bins change meaning with the zero-padding factor.
+    int primedNumBins = 0;
+    bool phasePrimed = false;
+};
@@ -0,0 +1,193 @@
+#include "SpectralWorker.h"
+#include "FFTProcessor.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+#elif JUCE_MAC
+ #include <dispatch/dispatch.h>
+#else
+ #include <semaphore.h>
+ #include <time.h>
+ #include <cerrno>
+#endif
+
+// Counting semaphore. Unlike juce::WaitableEvent, which signals under a
+// mutex, posting one is a single system call that never waits on a lock, so
+// the audio thread can do it.
+class WakeSemaphore
+{
+public:
+    WakeSemaphore()
+    {
+       #if JUCE_WINDOWS
+        handle = CreateSemaphore(nullptr, 0, LONG_MAX, nullptr);
+       #elif JUCE_MAC
+        handle = dispatch_semaphore_create(0);
+       #else
+        sem_init(&handle, 0, 0);
+       #endif
+    }
+
+    ~WakeSemaphore()
+    {
+       #if JUCE_WINDOWS
+        CloseHandle(handle);
+       #elif JUCE_MAC
+        dispatch_release(handle);
+       #else
+        sem_destroy(&handle);
+       #endif
+    }
+
+    void post()
+    {
+       #if JUCE_WINDOWS
+        ReleaseSemaphore(handle, 1, nullptr);
+       #elif JUCE_MAC
+        dispatch_semaphore_signal(handle);
+       #else
+        sem_post(&handle);
+       #endif
+    }
+
+    // Returns false if timeoutMs went by without a post.
+    bool wait(int timeoutMs)
+    {
+       #if JUCE_WINDOWS
+        return WaitForSingleObject(handle, (DWORD) timeoutMs) == WAIT_OBJECT_0;
+       #elif JUCE_MAC
+        return dispatch_semaphore_wait(handle, dispatch_time(DISPATCH_TIME_NOW, (int64_t) timeoutMs * 1000000)) == 0;
+       #else
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += (long) timeoutMs * 1000000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        while (sem_timedwait(&handle, &deadline) != 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return true;
+       #endif
+    }
+
+private:
+   #if JUCE_WINDOWS
+    HANDLE handle;
+   #elif JUCE_MAC
+    dispatch_semaphore_t handle;
+   #else
+    sem_t handle;
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE(WakeSemaphore)
+};
+
+class SpectralWorker::WorkerThread : public juce::Thread
+{
+public:
+    explicit WorkerThread(int index) :
+        juce::Thread("Loom spectral worker " + juce::String(index + 1))
+    {
+        startRealtimeThread(juce::Thread::RealtimeOptions{}.withPriority(8));
+    }
+
+    ~WorkerThread() override
+    {
+        signalThreadShouldExit();
+        semaphore.post();
+        stopThread(1000);
+    }
+
+    void wake()
+    {
+        // One post per batch of work is enough; the flag is cleared just
+        // before the thread looks for work, so nothing queued after that
+        // is missed.
+        if (!workPending.exchange(true, std::memory_order_acq_rel)) {
+            semaphore.post();
+        }
+    }
+
+    // Only the message thread changes these.
+    juce::CriticalSection lock;
+    std::vector<FFTProcessor*> processors;
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit()) {
+            // The timeout only guards against a missed wake-up.
+            semaphore.wait(10);
+            workPending.store(false, std::memory_order_release);
+
+            const juce::ScopedLock sl(lock);
+
+            for (auto* processor : processors) {
+                processor->runPendingJobs();
+            }
+        }
+    }
+
+    WakeSemaphore semaphore;
+    std::atomic<bool> workPending{ false };
+};
+
+SpectralWorker::SpectralWorker() :
+    maxThreads(juce::jmax(1, juce::SystemStats::getNumCpus() / 2))
+{
+    // wake() reads the vector from the audio thread, so it must never move.
+    threads.reserve((size_t) maxThreads);
+}
+
+SpectralWorker::~SpectralWorker()
+{
+}
+
+int SpectralWorker::add(FFTProcessor* processor)
+{
+    const juce::ScopedLock sl(lock);
+
+    // The least busy thread, or a new one if they're all full.
+    int best = -1;
+    size_t fewest = std::numeric_limits<size_t>::max();
+    for (int i = 0; i < (int) threads.size(); ++i) {
+        const juce::ScopedLock threadLock(threads[i]->lock);
+        auto& processors = threads[i]->processors;
+
+        if (std::find(processors.begin(), processors.end(), processor) != processors.end()) {
+            return i;
+        }
+        if (processors.size() < fewest) {
+            best = i;
+            fewest = processors.size();
+        }
+    }
+
+    if (best < 0 || (fewest >= (size_t) processorsPerThread && (int) threads.size() < maxThreads)) {
+        best = (int) threads.size();
+        threads.push_back(std::make_unique<WorkerThread>(best));
+    }
+
+    const juce::ScopedLock threadLock(threads[best]->lock);
+    threads[best]->processors.push_back(processor);
+    return best;
+}
+
+void SpectralWorker::remove(FFTProcessor* processor)
+{
+    const juce::ScopedLock sl(lock);
+
+    for (auto& thread : threads) {
+        // Held by the thread for a whole pass over its processors.
+        const juce::ScopedLock threadLock(thread->lock);
+        auto& processors = thread->processors;
+        processors.erase(std::remove(processors.begin(), processors.end(), processor), processors.end());
+    }
+}
+
+void SpectralWorker::wake(int thread)
+{
+    threads[thread]->wake();
+}
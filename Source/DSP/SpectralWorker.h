@@ -0,0 +1,44 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+class FFTProcessor;
+
+/**
+  Real-time priority threads that run the spectral work of pipelined
+  FFTProcessors off the audio thread.
+
+  Processors queue a frame per hop and collect the result on the next hop,
+  so as long as the workers keep up, the audio thread only copies frames in
+  and out. The pool is shared by every instance in the process; hold it
+  through a juce::SharedResourcePointer. Each thread serves up to
+  processorsPerThread processors, and threads are started as processors
+  are added, up to half the cores, so one slow processor only holds up the
+  others on its own thread.
+ */
+class SpectralWorker
+{
+public:
+    static constexpr int processorsPerThread = 8;
+
+    SpectralWorker();
+    ~SpectralWorker();
+
+    // Called from the message thread. add() returns the thread the processor
+    // was given, for wake(). Once remove() returns, no thread is touching the
+    // processor and none will again.
+    int add(FFTProcessor* processor);
+    void remove(FFTProcessor* processor);
+
+    // Called from the audio thread after queueing a frame. Never blocks.
+    void wake(int thread);
+
+private:
+    class WorkerThread;
+
+    const int maxThreads;
+    juce::CriticalSection lock;
+    std::vector<std::unique_ptr<WorkerThread>> threads;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectralWorker)
+};
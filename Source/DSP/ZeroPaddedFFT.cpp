@@ -0,0 +1,161 @@
+#include "ZeroPaddedFFT.h"
+
+ZeroPaddedFFT::ZeroPaddedFFT()
+{
+}
+
+void ZeroPaddedFFT::prepare(int fftOrder)
+{
+    fftSize = 1 << fftOrder;
+
+    fft = std::make_unique<juce::dsp::FFT>(fftOrder);
+
+    const int numTwiddles = maxPadFactor * fftSize;
+    twiddles.resize(numTwiddles);
+    for (int m = 0; m < numTwiddles; ++m) {
+        double angle = -2.0 * juce::MathConstants<double>::pi * m / numTwiddles;
+        twiddles[m] = { (float) std::cos(angle), (float) std::sin(angle) };
+    }
+
+    realScratch.assign(fftSize * 2, 0.0f);
+    complexIn.assign(fftSize, 0.0f);
+    complexOut.assign(fftSize, 0.0f);
+    accumulator.assign(fftSize, 0.0f);
+}
+
+void ZeroPaddedFFT::performForward(float* data, int padFactor)
+{
+    if (padFactor == 1) {
+        fft->performRealOnlyForwardTransform(data, true);
+        return;
+    }
+
+    jassert(padFactor == 2 || padFactor == 4);
+
+    auto* out = reinterpret_cast<std::complex<float>*>(data);
+    auto* residue0 = reinterpret_cast<std::complex<float>*>(realScratch.data());
+    const int half = fftSize / 2;
+
+    // Keep the input around, the output overwrites it.
+    std::copy(data, data + fftSize, accumulator.begin());
+
+    // Bins k*P are the unpadded spectrum.
+    std::copy(data, data + fftSize, realScratch.begin());
+    fft->performRealOnlyForwardTransform(realScratch.data(), true);
+    for (int k = 0; k <= half; ++k) {
+        out[k * padFactor] = residue0[k];
+    }
+
+    performForwardResidues(accumulator.data(), out, padFactor);
+}
+
+void ZeroPaddedFFT::performForwardPair(float* dataA, float* dataB, int padFactor)
+{
+    jassert(padFactor == 1 || padFactor == 2 || padFactor == 4);
+
+    auto* outA = reinterpret_cast<std::complex<float>*>(dataA);
+    auto* outB = reinterpret_cast<std::complex<float>*>(dataB);
+    const int half = fftSize / 2;
+
+    // The residues past 0 need the inputs after the outputs overwrite them.
+    if (padFactor > 1) {
+        std::copy(dataA, dataA + fftSize, accumulator.begin());
+        std::copy(dataB, dataB + fftSize, realScratch.begin());
+    }
+
+    for (int n = 0; n < fftSize; ++n) {
+        complexIn[n] = { dataA[n], dataB[n] };
+    }
+
+    fft->perform(complexIn.data(), complexOut.data(), false);
+
+    // With Z the FFT of a + ib, A[k] = (Z[k] + conj(Z[N - k])) / 2 and
+    // B[k] = (Z[k] - conj(Z[N - k])) / 2i.
+    for (int k = 0; k <= half; ++k) {
+        auto z = complexOut[k & (fftSize - 1)];
+        auto zc = std::conj(complexOut[(fftSize - k) & (fftSize - 1)]);
+        auto sum = z + zc;
+        auto difference = z - zc;
+
+        outA[k * padFactor] = 0.5f * sum;
+        outB[k * padFactor] = { 0.5f * difference.imag(), -0.5f * difference.real() };
+    }
+
+    // The other residues have complex inputs, which can't be packed.
+    if (padFactor > 1) {
+        performForwardResidues(accumulator.data(), outA, padFactor);
+        performForwardResidues(realScratch.data(), outB, padFactor);
+    }
+}
+
+void ZeroPaddedFFT::performForwardResidues(const float* input, std::complex<float>* out, int padFactor)
+{
+    const int half = fftSize / 2;
+    const int stride = maxPadFactor / padFactor;
+
+    // Bins k*P + r are the N-point FFT of the input modulated by
+    // exp(-2 pi i n r / (P N)). Bins k*P + (P - r) are the conjugates of the
+    // same FFT read backwards, so only r <= P/2 needs a transform.
+    for (int r = 1; r <= padFactor / 2; ++r) {
+        for (int n = 0; n < fftSize; ++n) {
+            complexIn[n] = input[n] * twiddles[n * r * stride];
+        }
+
+        fft->perform(complexIn.data(), complexOut.data(), false);
+
+        for (int k = 0; k < half; ++k) {
+            out[k * padFactor + r] = complexOut[k];
+        }
+        if (r != padFactor - r) {
+            for (int k = 0; k < half; ++k) {
+                out[k * padFactor + padFactor - r] = std::conj(complexOut[fftSize - 1 - k]);
+            }
+        }
+    }
+}
+
+void ZeroPaddedFFT::performInverse(float* data, int padFactor)
+{
+    if (padFactor == 1) {
+        fft->performRealOnlyInverseTransform(data);
+        return;
+    }
+
+    jassert(padFactor == 2 || padFactor == 4);
+
+    const auto* in = reinterpret_cast<const std::complex<float>*>(data);
+    auto* residue0 = reinterpret_cast<std::complex<float>*>(realScratch.data());
+    const int half = fftSize / 2;
+    const int paddedSize = fftSize * padFactor;
+    const int stride = maxPadFactor / padFactor;
+
+    // Residue 0 is Hermitian on its own, so it gets a real inverse.
+    for (int k = 0; k <= half; ++k) {
+        residue0[k] = in[k * padFactor];
+    }
+    fft->performRealOnlyInverseTransform(realScratch.data());
+    std::copy(realScratch.begin(), realScratch.begin() + fftSize, accumulator.begin());
+
+    // The other residues contribute exp(2 pi i n r / (P N)) times their N-point
+    // inverse. Residues r and P - r are conjugates, so their sum is twice the
+    // real part of either.
+    for (int r = 1; r <= padFactor / 2; ++r) {
+        for (int k = 0; k < fftSize; ++k) {
+            int m = k * padFactor + r;
+            complexIn[k] = m <= paddedSize / 2 ? in[m] : std::conj(in[paddedSize - m]);
+        }
+
+        fft->perform(complexIn.data(), complexOut.data(), true);
+
+        const float weight = r == padFactor - r ? 1.0f : 2.0f;
+        for (int n = 0; n < fftSize; ++n) {
+            auto twiddle = twiddles[n * r * stride];
+            accumulator[n] += weight * (complexOut[n].real() * twiddle.real() + complexOut[n].imag() * twiddle.imag());
+        }
+    }
+
+    const float scale = 1.0f / padFactor;
+    for (int n = 0; n < fftSize; ++n) {
+        data[n] = accumulator[n] * scale;
+    }
+}
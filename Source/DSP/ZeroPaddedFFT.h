@@ -0,0 +1,59 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Real FFT of an N-sample frame zero-padded to P*N samples, for P = 1, 2 or 4.
+
+  Padding gives P times finer bin spacing without a longer window or hop.
+  Because everything past the first N input samples is zero, the padded
+  transform splits into P interleaved N-point transforms of the frame, each
+  modulated by a twiddle. Real input makes residues r and P - r conjugates of
+  each other, so 4x padding costs one real and two complex N-point FFTs
+  rather than one 4N-point FFT. The inverse is pruned the same way and only
+  produces the first N output samples, which is all overlap-add needs.
+ */
+class ZeroPaddedFFT
+{
+public:
+    static constexpr int maxPadFactor = 4;
+
+    ZeroPaddedFFT();
+
+    void prepare(int fftOrder);
+
+    static constexpr int getNumBins(int fftSize, int padFactor) { return fftSize * padFactor / 2 + 1; }
+
+    // `data` must hold max(2 * fftSize, padFactor * fftSize + 2) floats.
+
+    // In place: takes fftSize windowed samples and returns the padded
+    // spectrum as getNumBins() interleaved complex numbers.
+    void performForward(float* data, int padFactor);
+
+    // Same as performForward() on both frames. The two real frames share one
+    // complex N-point FFT as dataA + i dataB, so a pair costs about as much
+    // as a single frame when unpadded.
+    void performForwardPair(float* dataA, float* dataB, int padFactor);
+
+    // In place: takes getNumBins() interleaved complex numbers and returns
+    // the first fftSize samples of the padded inverse transform.
+    void performInverse(float* data, int padFactor);
+
+private:
+    // Fills the padded bins k*P + r, r != 0, from fftSize samples of input.
+    void performForwardResidues(const float* input, std::complex<float>* out, int padFactor);
+
+    int fftSize = 0;
+
+    std::unique_ptr<juce::dsp::FFT> fft;
+
+    // exp(-2 pi i m / (maxPadFactor * fftSize)) for m = 0 .. maxPadFactor * fftSize - 1
+    std::vector<std::complex<float>> twiddles;
+
+    // Scratch space, sized in prepare().
+    std::vector<float> realScratch;
+    std::vector<std::complex<float>> complexIn, complexOut;
+    std::vector<float> accumulator;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ZeroPaddedFFT)
+};
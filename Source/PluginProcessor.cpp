@@ -8,7 +8,6 @@
 
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
-#include <fstream>  
 
 //==============================================================================
 LoomAudioProcessor::LoomAudioProcessor()
@@ -19,16 +18,30 @@ LoomAudioProcessor::LoomAudioProcessor()
         .withInput("Input", juce::AudioChannelSet::stereo(), true)
 #endif
         .withInput("AuxInput", juce::AudioChannelSet::stereo(), true)
+        .withInput("AuxInput 2", juce::AudioChannelSet::stereo(), false)
+        .withInput("AuxInput 3", juce::AudioChannelSet::stereo(), false)
         .withOutput("Output", juce::AudioChannelSet::stereo(), true)
 #endif
     )
 #endif
 {
+    numChannelsChanged();
+
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        fft[ch].setCapture(&signalCapture, ch);
+    }
+
+    hopSlots.fill(-1);
+
+    apvts.addParameterListener("capture", this);
+    apvts.addParameterListener("captureChannel", this);
 }
 
 LoomAudioProcessor::~LoomAudioProcessor()
 {
-
+    apvts.removeParameterListener("capture", this);
+    apvts.removeParameterListener("captureChannel", this);
+    cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -110,11 +123,167 @@ void LoomAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     //layout.getChannelSet(true, 1) = juce::AudioChannelSet::stereo();  // Set Aux Input Bus
     //setBusesLayout(layout);  // Apply the layout
 
+    auto chainSettings = getChainSettings(apvts);
+    auto family = (windowFamily) (int) chainSettings.window;
+
+    // The frame grows with the sample rate, so the bin spacing in Hz and the
+    // hop duration in ms stay close to what they are at 48 kHz.
+    auto fftOrder = FramePlanner::getFFTOrder(sampleRate, chainSettings.adaptiveFrame > 0.5f);
+
+    // The frame size, window and hop size are also only picked up here. Frames
+    // with a different window or hop can't be overlap-added to the ones in flight.
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        fft[ch].setFFTOrder(fftOrder);
+        fft[ch].setSampleRate(sampleRate);
+        fft[ch].setWindow(family, 1 << (int) chainSettings.overlap);
+    }
+
+    // Moving a hop offset moves where the frame in flight ends, so stagger is
+    // also only picked up here, before the processors are reset.
+    updateHopOffsets(chainSettings.hopStagger > 0.5f, (int) chainSettings.sidechainGroup);
+
+    // Pipelining changes the latency, so it's only picked up here rather
+    // than switched mid-stream. Hosts switch to offline rendering before
+    // preparing for it.
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        fft[ch].setPipelined(ch < getMainBusNumInputChannels() && chainSettings.pipelined > 0.5f);
+        fft[ch].setNonRealtime(isNonRealtime());
+    }
+
     setLatencySamples(fft[0].getLatencyInSamples());
 
-    fft[0].reset();
-    fft[1].reset();
+    auto frameSize = 1 << fftOrder;
+    signalCapture.prepare(sampleRate, frameSize, ZeroPaddedFFT::getNumBins(frameSize, ZeroPaddedFFT::maxPadFactor));
+
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        fft[ch].reset();
+    }
+
+    for (auto& bus : auxAnalyzer) {
+        for (auto& analyzer : bus) {
+            analyzer.prepare(fftOrder, family);
+        }
+    }
+
+    // Preparing the capture disarmed it. If "Capture" is on, carry on in a
+    // new take.
+    triggerAsyncUpdate();
+}
+
+void LoomAudioProcessor::updateHopOffsets(bool staggered, int sidechainGroup)
+{
+    hopsStaggered = staggered;
+
+    // Main channels routed to the same aux channel keep the same phase so
+    // they still share its analysis; only distinct routes are spread out.
+    // Sidechain-grouped instances take their phase from the aux channel so
+    // they stay aligned with the other instances in the group. Otherwise a
+    // route keeps the slot it was first given, so preparing again (for a new
+    // sample rate, say) doesn't move its frames.
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        int route = auxRouting[ch].load();
+        int key = route >= 0 ? route : maxChannels;
+
+        int slot = sidechainGroup > 0 ? key % HopScheduler::numSlots : hopSlots[key];
+        if (slot < 0 && staggered) {
+            slot = hopSlots[key] = hopScheduler->nextSlot();
+        }
+
+        int offset = staggered ? HopScheduler::getOffset(slot, fft[ch].getHopSize()) : 0;
+        fft[ch].setHopOffset(offset);
+    }
+}
+
+void LoomAudioProcessor::setCaptureDirectory(const juce::File& directory)
+{
+    apvts.state.setProperty("captureDirectory", directory.getFullPathName(), nullptr);
+}
+
+juce::File LoomAudioProcessor::getCaptureDirectory() const
+{
+    juce::String path = apvts.state.getProperty("captureDirectory").toString();
+    if (path.isEmpty()) {
+        return juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("Loom Captures");
+    }
+    return juce::File(path);
+}
+
+void LoomAudioProcessor::parameterChanged(const juce::String&, float)
+{
+    triggerAsyncUpdate();
+}
+
+void LoomAudioProcessor::handleAsyncUpdate()
+{
+    updateCapture();
+}
+
+void LoomAudioProcessor::updateCapture()
+{
+    bool shouldCapture = apvts.getRawParameterValue("capture")->load() > 0.5f;
+    int channel = (int) apvts.getRawParameterValue("captureChannel")->load();
+
+    if (shouldCapture == signalCapture.isArmed() && (!shouldCapture || channel == signalCapture.getChannel())) {
+        return;
+    }
+
+    // Not prepared yet; prepareToPlay() comes back here.
+    if (!shouldCapture || !signalCapture.isPrepared()) {
+        signalCapture.disarm();
+        return;
+    }
+
+    auto directory = getCaptureDirectory();
+    directory.createDirectory();
+    auto file = directory.getChildFile("Loom " + juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S"))
+                         .withFileExtension("wav")
+                         .getNonexistentSibling();
+
+    if (!signalCapture.arm(file, channel)) {
+        // Show that nothing is being captured.
+        apvts.getParameter("capture")->setValueNotifyingHost(0.0f);
+    }
+}
+
+void LoomAudioProcessor::resetCallbackStats()
+{
+    callbackProfiler[0].reset();
+    callbackProfiler[1].reset();
+}
+
+void LoomAudioProcessor::setMorphCurve(const MorphCurve& curve)
+{
+    morphCurve = curve;
+
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        fft[ch].setMorphCurve(curve);
+    }
+}
+
+void LoomAudioProcessor::numChannelsChanged()
+{
+    // Default routing: matching layouts pair up channel by channel, a mono aux
+    // feeds every main channel, and any other aux layout wraps around.
+    auto numAuxChannels = getBusCount(true) > 1 ? getChannelCountOfBus(true, 1) : 0;
+
+    for (int ch = 0; ch < maxChannels; ++ch) {
+        // Routes set through setAuxRoute() stay while they're still valid.
+        if (auxRouteIsCustom[ch] && auxRouting[ch].load() < numAuxChannels) {
+            continue;
+        }
+
+        auxRouteIsCustom[ch] = false;
+        auxRouting[ch] = numAuxChannels > 0 ? ch % numAuxChannels : -1;
+    }
+}
+
+void LoomAudioProcessor::setAuxRoute(int mainChannel, int auxChannel)
+{
+    jassert(mainChannel >= 0 && mainChannel < maxChannels);
+    jassert(auxChannel >= -1 && auxChannel < maxChannels);
 
+    auxRouting[mainChannel] = auxChannel;
+    auxRouteIsCustom[mainChannel] = true;
 }
 
 void LoomAudioProcessor::releaseResources()
@@ -127,30 +296,30 @@ void LoomAudioProcessor::releaseResources()
 bool LoomAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
 {
     // Check if the number of input and output buses match the expected count
-    if (layouts.inputBuses.size() != 2 || layouts.outputBuses.size() != 1)
-        return false; // Expect 2 input buses and 1 output bus
+    if (layouts.inputBuses.size() != 1 + FFTProcessor::maxAuxSources || layouts.outputBuses.size() != 1)
+        return false; // Expect the main input, the sidechain buses and 1 output bus
 
-    // Check that each input bus is stereo
     auto mainInput = layouts.getChannelSet(true, 0);
-    auto auxInput = layouts.getChannelSet(true, 1);
     auto output = layouts.getChannelSet(false, 0);
 
-    // Ensure all buses are stereo
-    if (mainInput == juce::AudioChannelSet::stereo() &&
-        auxInput == juce::AudioChannelSet::stereo() &&
-        output == juce::AudioChannelSet::stereo())
-    {
-        return true;
-    }
+    // Main input and output must match, anywhere from mono up to 7.1
+    if (mainInput.isDisabled() || mainInput != output || mainInput.size() > maxChannels)
+        return false;
 
-    return false;
+    // Each aux bus can be disabled, mono, or any layout up to the main layout's size
+    for (int bus = 1; bus < layouts.inputBuses.size(); ++bus) {
+        if (layouts.getChannelSet(true, bus).size() > mainInput.size())
+            return false;
+    }
 
+    return true;
 }
 #endif
 
 void LoomAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
     juce::ScopedNoDenormals noDenormals;
+    auto callbackStart = juce::Time::getHighResolutionTicks();
     auto numInputChannels = getTotalNumInputChannels();
     auto numOutputChannels = getTotalNumOutputChannels();
     auto numSamples = buffer.getNumSamples();
@@ -159,30 +328,132 @@ void LoomAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::M
         buffer.clear(i, 0, numSamples);
     }
 
-    float* channelL = buffer.getWritePointer(0);
-    float* channelR = buffer.getWritePointer(1);
-    float* channelLA = buffer.getWritePointer(2);
-    float* channelRA = buffer.getWritePointer(3);
+    auto mainBuffer = getBusBuffer(buffer, true, 0);
+    auto numMainChannels = juce::jmin(mainBuffer.getNumChannels(), maxChannels);
 
-    bool bypass = 0;
+    // Sidechain buses that are disabled (or that the host doesn't have) have
+    // no channels.
+    constexpr int numAuxBuses = FFTProcessor::maxAuxSources;
+    int numAuxChannels[numAuxBuses];
+    const float* auxData[numAuxBuses][maxChannels];
+
+    for (int bus = 0; bus < numAuxBuses; ++bus) {
+        numAuxChannels[bus] = 0;
+        if (bus + 1 < getBusCount(true)) {
+            auto auxBuffer = getBusBuffer(buffer, true, bus + 1);
+            numAuxChannels[bus] = juce::jmin(auxBuffer.getNumChannels(), maxChannels);
+
+            for (int ch = 0; ch < numAuxChannels[bus]; ++ch) {
+                auxData[bus][ch] = auxBuffer.getReadPointer(ch);
+            }
+        }
+    }
+
+    // Resolve the routing matrix once per block. Each aux channel is analysed
+    // at most once per hop, no matter how many main channels read it.
+    float* channelData[maxChannels];
+    FFTProcessor::AuxSources channelAux[maxChannels];
+
+    for (int ch = 0; ch < numMainChannels; ++ch) {
+        auto route = auxRouting[ch].load();
+        channelData[ch] = mainBuffer.getWritePointer(ch);
+        channelAux[ch][0] = route >= 0 && route < numAuxChannels[0] ? &auxAnalyzer[0][route] : nullptr;
+
+        for (int bus = 1; bus < numAuxBuses; ++bus) {
+            channelAux[ch][bus] = numAuxChannels[bus] > 0 ? &auxAnalyzer[bus][ch % numAuxChannels[bus]] : nullptr;
+        }
+    }
 
     auto chainSettings = getChainSettings(apvts);
 
+    // Instances in the same sidechain group share aux analysis through the
+    // process-wide cache. Hops are matched on the host timeline, which is
+    // only meaningful while the transport is running.
+    int sidechainGroup = (int) chainSettings.sidechainGroup;
+    juce::int64 timelinePosition = -1;
+
+    if (sidechainGroup > 0) {
+        if (auto* playHead = getPlayHead()) {
+            if (auto position = playHead->getPosition()) {
+                if (position->getIsPlaying() && position->getTimeInSamples().hasValue()) {
+                    timelinePosition = *position->getTimeInSamples();
+                }
+            }
+        }
+    }
+
+    // Only the first sidechain bus is shared; the cache has one slot per
+    // channel of it.
+    for (int ch = 0; ch < numAuxChannels[0]; ++ch) {
+        auxAnalyzer[0][ch].setSharedCache(sharedAuxCache.get(), sidechainGroup, ch);
+        auxAnalyzer[0][ch].setTimelinePosition(timelinePosition);
+    }
 
-    // Processing on a sample-by-sample basis:
-    for (int sample = 0; sample < numSamples; ++sample) {
-        float sampleL = channelL[sample];
-        float sampleR = channelR[sample];
-        float sampleLA = channelLA[sample];
-        float sampleRA = channelRA[sample];
 
-        sampleL = fft[0].processSample(sampleL, sampleLA, chainSettings);
-        sampleR = fft[1].processSample(sampleR, sampleRA, chainSettings);
+    // Each aux channel on the first bus is delayed by the alignment estimate
+    // of the first main channel routed to it.
+    bool aligning = (int) chainSettings.alignment != alignOff;
+    bool auxDelaySet[maxChannels] = {};
 
-        channelL[sample] = sampleL;
-        channelR[sample] = sampleR;
+    for (int ch = 0; ch < numMainChannels; ++ch) {
+        auto route = auxRouting[ch].load();
+        if (route >= 0 && route < numAuxChannels[0] && !auxDelaySet[route]) {
+            auxAnalyzer[0][route].setDelay(aligning ? fft[ch].getAlignmentDelay() : 0.0f);
+            auxDelaySet[route] = true;
+        }
+    }
+
+    // Capturing only copies into preallocated rings; the files are written
+    // by the capture's own thread.
+    int captureChannel = signalCapture.getChannel();
+    bool capturing = signalCapture.isArmed() && captureChannel < numMainChannels;
+
+    if (capturing) {
+        auto route = auxRouting[captureChannel].load();
+        signalCapture.pushInputs(channelData[captureChannel], route >= 0 && route < numAuxChannels[0] ? auxData[0][route] : nullptr, numSamples);
+    }
+
+    // Once every channel has faded out to the delayed input, bypassing is
+    // just block copies through each channel's history.
+    bool fullyBypassed = chainSettings.bypassed > 0.5f;
+    for (int ch = 0; ch < numMainChannels; ++ch) {
+        fullyBypassed = fullyBypassed && fft[ch].isBypassed();
+    }
+
+    if (fullyBypassed) {
+        for (int bus = 0; bus < numAuxBuses; ++bus) {
+            for (int ch = 0; ch < numAuxChannels[bus]; ++ch) {
+                auxAnalyzer[bus][ch].pushBlock(auxData[bus][ch], numSamples);
+            }
+        }
+
+        for (int ch = 0; ch < numMainChannels; ++ch) {
+            fft[ch].processBypassedBlock(channelData[ch], numSamples);
+        }
+    }
+    else {
+        // Processing on a sample-by-sample basis:
+        for (int sample = 0; sample < numSamples; ++sample) {
+            for (int bus = 0; bus < numAuxBuses; ++bus) {
+                for (int ch = 0; ch < numAuxChannels[bus]; ++ch) {
+                    auxAnalyzer[bus][ch].pushSample(auxData[bus][ch][sample]);
+                }
+            }
+
+            for (int ch = 0; ch < numMainChannels; ++ch) {
+                channelData[ch][sample] = fft[ch].processSample(channelData[ch][sample], channelAux[ch], chainSettings);
+            }
+        }
+    }
+
+    if (capturing) {
+        signalCapture.pushOutput(channelData[captureChannel]);
+    }
+
+    if (chainSettings.measureCallbacks > 0.5f) {
+        auto elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - callbackStart);
+        callbackProfiler[hopsStaggered ? 1 : 0].addCallback(elapsed * 1.0e6, numSamples, getSampleRate());
     }
-    
 }
 
 //==============================================================================
@@ -204,6 +475,10 @@ void LoomAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
 
+    // The parameters, and the capture directory stored alongside them.
+    if (auto xml = apvts.copyState().createXml()) {
+        copyXmlToBinary(*xml, destData);
+    }
 }
 
 void LoomAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
@@ -211,7 +486,14 @@ void LoomAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
 
-    
+    if (auto xml = getXmlFromBinary(data, sizeInBytes)) {
+        if (xml->hasTagName(apvts.state.getType())) {
+            apvts.replaceState(juce::ValueTree::fromXml(*xml));
+        }
+    }
+
+    // A session doesn't start capturing as soon as it's opened.
+    apvts.getParameter("capture")->setValueNotifyingHost(0.0f);
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout
@@ -221,10 +503,28 @@ LoomAudioProcessor::createParameterLayout()
 
     layout.add(std::make_unique<juce::AudioParameterFloat>("bypassed", "Bypass", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("morphFactor", "Morph Factor", juce::NormalisableRange <float>(0.f,1.f,0.02f, 1.f), 0.5f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("mainWeight", "Main Weight", juce::NormalisableRange <float>(0.f, 1.f, 0.01f, 1.f), 0.5f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("auxWeight1", "Aux 1 Weight", juce::NormalisableRange <float>(0.f, 1.f, 0.01f, 1.f), 0.5f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("auxWeight2", "Aux 2 Weight", juce::NormalisableRange <float>(0.f, 1.f, 0.01f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("auxWeight3", "Aux 3 Weight", juce::NormalisableRange <float>(0.f, 1.f, 0.01f, 1.f), 0.f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("formantShiftFactor", "Formant", juce::NormalisableRange <float>(0.f, 2.f, 0.05f, 1.f), 1.f));
-    layout.add(std::make_unique<juce::AudioParameterFloat>("magProcessing", "Magnitude Processing", juce::NormalisableRange <float>(0.f, 5.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("magProcessing", "Magnitude Processing", juce::NormalisableRange <float>(0.f, 6.f, 1.f, 1.f), 0.f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("phaseProcessing", "Phase Processing", juce::NormalisableRange <float>(0.f, 5.f, 1.f, 1.f), 0.f));
     layout.add(std::make_unique<juce::AudioParameterFloat>("invertPhase", "Invert Phase", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("zeroPadding", "Zero Padding", juce::NormalisableRange <float>(0.f, 2.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("window", "Window", juce::NormalisableRange <float>(0.f, 3.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("overlap", "Overlap", juce::NormalisableRange <float>(1.f, 3.f, 1.f, 1.f), 2.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("adaptiveFrame", "Adaptive Frame Size", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("alignment", "Aux Alignment", juce::NormalisableRange <float>(0.f, 2.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("smoothAttack", "Smoothing Attack", juce::NormalisableRange <float>(0.f, 200.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("smoothRelease", "Smoothing Release", juce::NormalisableRange <float>(0.f, 1000.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("phaseSmoothing", "Phase Smoothing", juce::NormalisableRange <float>(0.f, 1.f, 0.01f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("sidechainGroup", "Sidechain Group", juce::NormalisableRange <float>(0.f, 16.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("hopStagger", "Hop Stagger", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("pipelined", "Pipelined", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("measureCallbacks", "Measure Callbacks", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("capture", "Capture", juce::NormalisableRange <float>(0.f, 1.f, 1.f, 1.f), 0.f));
+    layout.add(std::make_unique<juce::AudioParameterFloat>("captureChannel", "Capture Channel", juce::NormalisableRange <float>(0.f, (float) (maxChannels - 1), 1.f, 1.f), 0.f));
     
 
     return layout;
@@ -258,38 +558,32 @@ void LoomAudioProcessor::generateSineWave(juce::AudioBuffer<float>& buffer, floa
     }
 }
 
-void LoomAudioProcessor::outputToCSV(float* data, int numSamples, const std::string& fileName)
-{
-    // Open a file in write mode
-    std::ofstream file(fileName);
-
-    if (!file.is_open()) {
-        std::cerr << "Error opening file!" << std::endl;
-        return;
-    }
-
-    // Write data to the CSV file
-    for (size_t i = 0; i < numSamples; ++i) {
-        file << data[i];
-        if (i < numSamples - 1) {
-            file << ",";  // Separate values by commas
-        }
-    }
-
-    // Close the file
-    file.close();
-}
-
 ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts)
 {
     ChainSettings settings;
 
     settings.bypassed = apvts.getRawParameterValue("bypassed")->load(); // Non-normalized parameters
     settings.morphFactor = apvts.getRawParameterValue("morphFactor")->load(); // Non-normalized parameters
+    settings.mainWeight = apvts.getRawParameterValue("mainWeight")->load(); // Non-normalized parameters
+    settings.auxWeight1 = apvts.getRawParameterValue("auxWeight1")->load(); // Non-normalized parameters
+    settings.auxWeight2 = apvts.getRawParameterValue("auxWeight2")->load(); // Non-normalized parameters
+    settings.auxWeight3 = apvts.getRawParameterValue("auxWeight3")->load(); // Non-normalized parameters
     settings.formantShiftFactor = apvts.getRawParameterValue("formantShiftFactor")->load(); // Non-normalized parameters
     settings.magProcessing = apvts.getRawParameterValue("magProcessing")->load(); // Non-normalized parameters
     settings.phaseProcessing = apvts.getRawParameterValue("phaseProcessing")->load(); // Non-normalized parameters
     settings.invertPhase = apvts.getRawParameterValue("invertPhase")->load(); // Non-normalized parameters
+    settings.zeroPadding = apvts.getRawParameterValue("zeroPadding")->load(); // Non-normalized parameters
+    settings.window = apvts.getRawParameterValue("window")->load(); // Non-normalized parameters
+    settings.overlap = apvts.getRawParameterValue("overlap")->load(); // Non-normalized parameters
+    settings.adaptiveFrame = apvts.getRawParameterValue("adaptiveFrame")->load(); // Non-normalized parameters
+    settings.alignment = apvts.getRawParameterValue("alignment")->load(); // Non-normalized parameters
+    settings.smoothAttack = apvts.getRawParameterValue("smoothAttack")->load(); // Non-normalized parameters
+    settings.smoothRelease = apvts.getRawParameterValue("smoothRelease")->load(); // Non-normalized parameters
+    settings.phaseSmoothing = apvts.getRawParameterValue("phaseSmoothing")->load(); // Non-normalized parameters
+    settings.sidechainGroup = apvts.getRawParameterValue("sidechainGroup")->load(); // Non-normalized parameters
+    settings.hopStagger = apvts.getRawParameterValue("hopStagger")->load(); // Non-normalized parameters
+    settings.pipelined = apvts.getRawParameterValue("pipelined")->load(); // Non-normalized parameters
+    settings.measureCallbacks = apvts.getRawParameterValue("measureCallbacks")->load(); // Non-normalized parameters
     
 
     return settings;
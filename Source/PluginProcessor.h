@@ -14,6 +14,10 @@
 #include "DSP/FFTProcessor.h"
 #include "DSP/MorphProcessor.h"
 #include "DSP/FormantShiftProcessor.h"
+#include "DSP/HopScheduler.h"
+#include "DSP/FramePlanner.h"
+#include "CallbackProfiler.h"
+#include "SignalCapture.h"
 
 //==============================================================================
 /**
@@ -34,7 +38,9 @@ ChainSettings getChainSettings(juce::AudioProcessorValueTreeState& apvts);
 
 
 
-class LoomAudioProcessor  : public juce::AudioProcessor
+class LoomAudioProcessor  : public juce::AudioProcessor,
+                            private juce::AudioProcessorValueTreeState::Listener,
+                            private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -50,6 +56,7 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void numChannelsChanged() override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -84,7 +91,39 @@ public:
     "Parameters",createParameterLayout()
     };
 
-    void outputToCSV(float* data, int numSamples, const std::string& fileName);
+    // Up to 7.1 on the main bus.
+    static constexpr int maxChannels = 8;
+
+    // Routes main channel `mainChannel` to the aux channel whose analysis it
+    // morphs against, or -1 for none. Main channels that share an aux channel
+    // share its analysis. Defaults are set from the bus layout whenever it
+    // changes (numChannelsChanged()); a route set here survives a layout
+    // change as long as its aux channel still exists, and otherwise goes
+    // back to the default. Applies to the first sidechain bus; the others,
+    // which only Weighted Morph reads, always wrap channel by channel.
+    void setAuxRoute(int mainChannel, int auxChannel);
+    int getAuxRoute(int mainChannel) const { return auxRouting[mainChannel].load(); }
+
+    // Callback cost while "Measure Callbacks" is on, kept separately for
+    // blocks processed with and without hop staggering. "Hop Stagger" takes
+    // effect at the next prepareToPlay().
+    CallbackProfiler::Stats getCallbackStats(bool staggered) const { return callbackProfiler[staggered ? 1 : 0].getStats(); }
+    void resetCallbackStats();
+
+    // Per-bin blend amounts for the Linear Blend magnitude mode. Call from the
+    // message thread, e.g. while the curve is being drawn; takes effect on
+    // each channel's next frame without blocking the audio thread.
+    void setMorphCurve(const MorphCurve& curve);
+    const MorphCurve& getMorphCurve() const { return morphCurve; }
+
+    // Debug capture of one channel's inputs, output and spectra. Can be armed
+    // and disarmed from the message thread while playing.
+    SignalCapture& getSignalCapture() { return signalCapture; }
+
+    // Where the "Capture" parameter writes its files, one pair per take.
+    // Saved with the session; the user's documents folder by default.
+    void setCaptureDirectory(const juce::File& directory);
+    juce::File getCaptureDirectory() const;
 private:
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LoomAudioProcessor)
@@ -125,7 +164,31 @@ private:
     //FirstStage leftChainV, rightChainV, leftChainH, rightChainH;
 
     SecondStage leftChain, rightChain, leftAuxChain, rightAuxChain;
-    FFTProcessor fft[2];
+
+    // Declared before the FFTProcessors, which hold a pointer to it.
+    SignalCapture signalCapture;
+    FFTProcessor fft[maxChannels];
+    AuxAnalyzer auxAnalyzer[FFTProcessor::maxAuxSources][maxChannels];
+    juce::SharedResourcePointer<SharedAuxCache> sharedAuxCache;
+    juce::SharedResourcePointer<HopScheduler> hopScheduler;
+
+    // "Capture" can be automated from the audio thread, so the change is
+    // passed on to the message thread, where the capture is armed.
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    void handleAsyncUpdate() override;
+    void updateCapture();
+
+    // Spreads the hop phases of channels that don't share an aux analysis.
+    void updateHopOffsets(bool staggered, int sidechainGroup);
+    bool hopsStaggered = false;
+
+    // The HopScheduler slot each aux route (or none, last) was given, or -1.
+    std::array<int, maxChannels + 1> hopSlots;
+
+    CallbackProfiler callbackProfiler[2];
+    MorphCurve morphCurve;
+    std::array<std::atomic<int>, maxChannels> auxRouting;
+    std::array<bool, maxChannels> auxRouteIsCustom{};
     MorphProcessor morphProcessor;
     FormantShiftProcessor formantProcessor;
 
@@ -0,0 +1,245 @@
+#include "SignalCapture.h"
+
+SignalCapture::SignalCapture() :
+    juce::Thread("Loom capture writer")
+{
+}
+
+SignalCapture::~SignalCapture()
+{
+    disarm();
+}
+
+void SignalCapture::prepare(double newSampleRate, int newFFTSize, int newMaxNumBins)
+{
+    disarm();
+
+    sampleRate = newSampleRate;
+    fftSize = newFFTSize;
+    maxNumBins = newMaxNumBins;
+    pendingBlock = false;
+}
+
+void SignalCapture::allocateRings()
+{
+    // Two seconds of audio and 64 hops are plenty for the writer to keep up,
+    // and bound the memory a capture can use.
+    const int ringSize = juce::jmax(1, (int) (sampleRate * 2.0));
+    audioFifo.setTotalSize(ringSize);
+    audioRing.setSize(numAudioChannels, ringSize);
+    audioRing.clear();
+
+    spectrumFifo.reset();
+    spectrumRing.assign((size_t) numSpectrumSlots * maxNumBins * 2, 0.0f);
+    magnitudes.assign(maxNumBins, 0.0f);
+}
+
+void SignalCapture::freeRings()
+{
+    audioRing.setSize(0, 0);
+    std::vector<float>().swap(spectrumRing);
+    std::vector<float>().swap(magnitudes);
+}
+
+bool SignalCapture::arm(const juce::File& file, int channel)
+{
+    disarm();
+
+    if (fftSize == 0) {
+        jassertfalse; // prepare() hasn't been called
+        return false;
+    }
+
+    auto wavFile = file.withFileExtension("wav");
+    auto spectraFile = file.withFileExtension("spectra");
+    wavFile.deleteFile();
+    spectraFile.deleteFile();
+
+    auto wavStream = std::make_unique<juce::FileOutputStream>(wavFile);
+    if (!wavStream->openedOk()) {
+        return false;
+    }
+
+    juce::WavAudioFormat wav;
+    audioWriter.reset(wav.createWriterFor(wavStream.get(), sampleRate, numAudioChannels, 32, {}, 0));
+    if (audioWriter == nullptr) {
+        return false;
+    }
+    wavStream.release(); // now owned by the writer
+
+    spectrumStream = std::make_unique<juce::FileOutputStream>(spectraFile);
+    if (!spectrumStream->openedOk()) {
+        audioWriter.reset();
+        spectrumStream.reset();
+        return false;
+    }
+
+    spectrumStream->write("LMSP", 4);
+    spectrumStream->writeInt(1);
+    spectrumStream->writeInt(fftSize);
+    spectrumStream->writeInt(0);
+
+    allocateRings();
+
+    droppedSamples = 0;
+    droppedHops = 0;
+    hopsPushed = 0;
+    captureChannel = channel;
+    ++take;
+
+    startThread(juce::Thread::Priority::low);
+    armed.store(true, std::memory_order_release);
+    return true;
+}
+
+void SignalCapture::disarm()
+{
+    armed.store(false);
+
+    // A push that saw the capture armed may still be copying into the rings.
+    while (numPushing.load() != 0) {
+        std::this_thread::yield();
+    }
+
+    if (isThreadRunning()) {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+    }
+
+    if (audioWriter != nullptr) {
+        drain();
+        audioWriter.reset();
+        spectrumStream.reset();
+        freeRings();
+    }
+}
+
+void SignalCapture::pushInputs(const float* main, const float* aux, int numSamples)
+{
+    pendingBlock = false;
+
+    if (!armed.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    ScopedPush push(*this);
+    if (!armed.load()) {
+        return;
+    }
+
+    if (audioFifo.getFreeSpace() < numSamples) {
+        droppedSamples += numSamples;
+        return;
+    }
+
+    audioFifo.prepareToWrite(numSamples, pendingStart1, pendingSize1, pendingStart2, pendingSize2);
+
+    auto copy = [this](int channel, const float* src) {
+        if (src != nullptr) {
+            audioRing.copyFrom(channel, pendingStart1, src, pendingSize1);
+            audioRing.copyFrom(channel, pendingStart2, src + pendingSize1, pendingSize2);
+        }
+        else {
+            audioRing.clear(channel, pendingStart1, pendingSize1);
+            audioRing.clear(channel, pendingStart2, pendingSize2);
+        }
+    };
+
+    copy(0, main);
+    copy(1, aux);
+    pendingBlock = true;
+    pendingTake = take.load(std::memory_order_relaxed);
+}
+
+void SignalCapture::pushOutput(const float* output)
+{
+    if (!pendingBlock) {
+        return;
+    }
+    pendingBlock = false;
+
+    ScopedPush push(*this);
+    if (!armed.load() || take.load(std::memory_order_relaxed) != pendingTake) {
+        return;
+    }
+
+    audioRing.copyFrom(2, pendingStart1, output, pendingSize1);
+    audioRing.copyFrom(2, pendingStart2, output + pendingSize1, pendingSize2);
+    audioFifo.finishedWrite(pendingSize1 + pendingSize2);
+}
+
+void SignalCapture::pushSpectrum(int channel, const float* spectrum, int numBins)
+{
+    if (!armed.load(std::memory_order_relaxed) || channel != captureChannel.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    ScopedPush push(*this);
+    if (!armed.load()) {
+        return;
+    }
+
+    const juce::int64 hop = hopsPushed.fetch_add(1, std::memory_order_relaxed);
+
+    int start1, size1, start2, size2;
+    spectrumFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 == 0 || numBins > maxNumBins) {
+        droppedHops += 1;
+        return;
+    }
+
+    spectrumSlots[start1] = { hop, numBins };
+    std::memcpy(spectrumRing.data() + (size_t) start1 * maxNumBins * 2, spectrum, numBins * 2 * sizeof(float));
+    spectrumFifo.finishedWrite(1);
+}
+
+void SignalCapture::run()
+{
+    while (!threadShouldExit()) {
+        drain();
+        wait(50);
+    }
+}
+
+void SignalCapture::drain()
+{
+    int start1, size1, start2, size2;
+
+    audioFifo.prepareToRead(audioFifo.getNumReady(), start1, size1, start2, size2);
+
+    auto writeAudio = [this](int start, int size) {
+        if (size > 0) {
+            const float* channels[numAudioChannels];
+            for (int ch = 0; ch < numAudioChannels; ++ch) {
+                channels[ch] = audioRing.getReadPointer(ch, start);
+            }
+            audioWriter->writeFromFloatArrays(channels, numAudioChannels, size);
+        }
+    };
+
+    writeAudio(start1, size1);
+    writeAudio(start2, size2);
+    audioFifo.finishedRead(size1 + size2);
+
+    spectrumFifo.prepareToRead(spectrumFifo.getNumReady(), start1, size1, start2, size2);
+
+    auto writeSpectra = [this](int start, int size) {
+        for (int slot = start; slot < start + size; ++slot) {
+            const auto& info = spectrumSlots[slot];
+            const float* spectrum = spectrumRing.data() + (size_t) slot * maxNumBins * 2;
+
+            for (int i = 0; i < info.numBins; ++i) {
+                magnitudes[i] = std::hypot(spectrum[2 * i], spectrum[2 * i + 1]);
+            }
+
+            spectrumStream->writeInt64(info.hop);
+            spectrumStream->writeInt(info.numBins);
+            spectrumStream->write(magnitudes.data(), info.numBins * sizeof(float));
+        }
+    };
+
+    writeSpectra(start1, size1);
+    writeSpectra(start2, size2);
+    spectrumFifo.finishedRead(size1 + size2);
+}
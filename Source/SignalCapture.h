@@ -0,0 +1,117 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+  Debug capture of one channel's main input, aux input, output and per-hop
+  spectra, safe to arm in a running session.
+
+  The audio thread (and, for spectra, whichever thread runs the channel's
+  frames) only copies into rings allocated by arm() and freed by disarm(),
+  so an instance that never captures doesn't hold them. A background thread
+  drains them into `<name>.wav` (main, aux and output as three 32-bit float
+  channels) and `<name>.spectra`. When a ring is full, data is dropped and
+  counted rather than waited for.
+
+  The .spectra file is a 16-byte header ("LMSP", version, fftSize, unused)
+  followed by one record per hop: a 64-bit hop index, a 32-bit bin count
+  and that many 32-bit float magnitudes. Hop indices skip over dropped hops.
+ */
+class SignalCapture : private juce::Thread
+{
+public:
+    SignalCapture();
+    ~SignalCapture() override;
+
+    // Sets the sizes of the rings, which are only allocated while armed.
+    // Disarms first if armed. Call from the message thread.
+    void prepare(double sampleRate, int fftSize, int maxNumBins);
+
+    // Allocates the rings and starts writing next to `file` (its extension
+    // is replaced), capturing main channel `channel`. Returns false if the
+    // files can't be created. Call from the message thread.
+    bool arm(const juce::File& file, int channel);
+
+    // Stops capturing, writes out whatever is still in the rings and frees
+    // them. Waits for a push in progress on another thread to finish.
+    void disarm();
+
+    // arm() only works once prepare() has been called.
+    bool isPrepared() const { return fftSize > 0; }
+    bool isArmed() const { return armed.load(std::memory_order_relaxed); }
+    int getChannel() const { return captureChannel.load(std::memory_order_relaxed); }
+    juce::int64 getNumDroppedSamples() const { return droppedSamples.load(); }
+    juce::int64 getNumDroppedHops() const { return droppedHops.load(); }
+
+    // Audio thread, once per block while armed: pushInputs() before the
+    // block is processed and pushOutput() after. aux may be nullptr.
+    void pushInputs(const float* main, const float* aux, int numSamples);
+    void pushOutput(const float* output);
+
+    // Called after processSpectrum for every hop of every channel; only the
+    // captured channel's hops are kept. Frames of one channel must not be
+    // pushed from two threads at once.
+    void pushSpectrum(int channel, const float* spectrum, int numBins);
+
+private:
+    void run() override;
+
+    // Moves everything in the rings to the files. Reader side only.
+    void drain();
+
+    void allocateRings();
+    void freeRings();
+
+    // Held by every push while it may touch the rings, so that disarm() can
+    // wait for it before freeing them.
+    struct ScopedPush
+    {
+        explicit ScopedPush(SignalCapture& c) : capture(c) { capture.numPushing.fetch_add(1); }
+        ~ScopedPush() { capture.numPushing.fetch_sub(1); }
+
+        SignalCapture& capture;
+    };
+
+    static constexpr int numAudioChannels = 3;      // main, aux, output
+    static constexpr int numSpectrumSlots = 64;
+
+    std::atomic<bool> armed{ false };
+    std::atomic<int> numPushing{ 0 };
+    std::atomic<int> captureChannel{ 0 };
+    std::atomic<juce::int64> droppedSamples{ 0 };
+    std::atomic<juce::int64> droppedHops{ 0 };
+
+    double sampleRate = 44100.0;
+    int fftSize = 0;
+    int maxNumBins = 0;
+
+    // Audio: the region reserved by pushInputs() is committed by pushOutput().
+    juce::AbstractFifo audioFifo{ 1 };
+    juce::AudioBuffer<float> audioRing;
+    int pendingStart1 = 0, pendingSize1 = 0, pendingStart2 = 0, pendingSize2 = 0;
+    bool pendingBlock = false;
+
+    // Counts arm() calls, so a block reserved before a disarm isn't
+    // committed to the next take's rings.
+    std::atomic<juce::uint32> take{ 0 };
+    juce::uint32 pendingTake = 0;
+
+    // Spectra: one interleaved complex spectrum per slot.
+    struct SpectrumSlot
+    {
+        juce::int64 hop = 0;
+        int numBins = 0;
+    };
+
+    juce::AbstractFifo spectrumFifo{ numSpectrumSlots };
+    std::array<SpectrumSlot, numSpectrumSlots> spectrumSlots;
+    std::vector<float> spectrumRing;
+    std::atomic<juce::int64> hopsPushed{ 0 };
+
+    // Owned by the writer thread while armed, by the message thread otherwise.
+    std::unique_ptr<juce::AudioFormatWriter> audioWriter;
+    std::unique_ptr<juce::FileOutputStream> spectrumStream;
+    std::vector<float> magnitudes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SignalCapture)
+};
@@ -0,0 +1,540 @@
+/*
+  ==============================================================================
+
+    Headless stress host for Loom.
+
+    Runs many LoomAudioProcessor instances through a simulated host graph:
+    every cycle, a pool of host threads processes all instances with the
+    same (often irregular) block size while parameters are automated, and
+    the cycle has to finish within the duration of the block. Reports
+    deadline misses, worst callback and cycle times, and the resident
+    memory each instance adds.
+
+    Usage: LoomStress [--instances N] [--threads N] [--seconds S]
+                      [--rate HZ] [--maxblock N] [--pipelined] [--realtime]
+                      [--stagger]
+
+    --stagger runs the first half with "Hop Stagger" off and the second with
+    it on, re-preparing every instance in between, and prints the plugin's
+    own callback stats for each.
+
+    LoomStress --offline [--seconds S] [--passes N] times offline renders of
+    S seconds with N different settings, once straight through
+    FFTProcessor and once from a SpectralFrameCache analysed up front.
+
+    LoomStress --spectrum [--frames N] times FFTProcessor::processSpectrum()
+    on its own, N frames of every mode combination at 513 and 2049 bins.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+#include "../../../Source/DSP/SpectralFrameCache.h"
+
+#if JUCE_WINDOWS
+ #include <windows.h>
+ #include <psapi.h>
+ #pragma comment(lib, "psapi.lib")
+#elif JUCE_MAC
+ #include <mach/mach.h>
+#endif
+
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter();
+
+// Resident set size of this process, or 0 if unknown.
+static juce::int64 getResidentBytes()
+{
+   #if JUCE_WINDOWS
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return (juce::int64) counters.WorkingSetSize;
+    }
+   #elif JUCE_MAC
+    mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t) &info, &count) == KERN_SUCCESS) {
+        return (juce::int64) info.resident_size;
+    }
+   #elif JUCE_LINUX
+    juce::StringArray fields;
+    fields.addTokens(juce::File("/proc/self/statm").loadFileAsString(), " ", "");
+    if (fields.size() > 1) {
+        return fields[1].getLargeIntValue() * 4096;
+    }
+   #endif
+    return 0;
+}
+
+struct StressOptions
+{
+    int numInstances = 64;
+    int numThreads = juce::jmax(1, juce::SystemStats::getNumCpus() - 1);
+    double seconds = 10.0;
+    double sampleRate = 48000.0;
+    int maxBlockSize = 1024;
+    bool pipelined = false;
+    bool realtime = false;
+    bool compareStagger = false;
+    bool offline = false;
+    int numPasses = 8;
+    bool spectrum = false;
+    int numFrames = 2000;
+};
+
+static StressOptions parseOptions(const juce::StringArray& args)
+{
+    StressOptions options;
+
+    for (int i = 0; i < args.size(); ++i) {
+        auto next = [&]() { return i + 1 < args.size() ? args[++i] : juce::String(); };
+
+        if (args[i] == "--instances") options.numInstances = juce::jmax(1, next().getIntValue());
+        else if (args[i] == "--threads") options.numThreads = juce::jmax(1, next().getIntValue());
+        else if (args[i] == "--seconds") options.seconds = next().getDoubleValue();
+        else if (args[i] == "--rate") options.sampleRate = next().getDoubleValue();
+        else if (args[i] == "--maxblock") options.maxBlockSize = juce::jlimit(32, 8192, next().getIntValue());
+        else if (args[i] == "--pipelined") options.pipelined = true;
+        else if (args[i] == "--realtime") options.realtime = true;
+        else if (args[i] == "--stagger") options.compareStagger = true;
+        else if (args[i] == "--offline") options.offline = true;
+        else if (args[i] == "--passes") options.numPasses = juce::jmax(1, next().getIntValue());
+        else if (args[i] == "--spectrum") options.spectrum = true;
+        else if (args[i] == "--frames") options.numFrames = juce::jmax(1, next().getIntValue());
+    }
+
+    return options;
+}
+
+// Block sizes a host might use. Mostly powers of two, with some of the odd
+// sizes seen from hosts that split blocks at automation points or loop ends.
+static int nextBlockSize(juce::Random& random, int maxBlockSize)
+{
+    static const int common[] = { 32, 64, 128, 256, 441, 480, 512, 1024 };
+
+    int size = random.nextInt(4) == 0 ? 32 + random.nextInt(maxBlockSize - 31)
+                                      : common[random.nextInt((int) std::size(common))];
+    return juce::jmin(size, maxBlockSize);
+}
+
+/**
+  One plugin instance and the buffers and automation state the host keeps
+  for it.
+ */
+struct Instance
+{
+    std::unique_ptr<juce::AudioProcessor> processor;
+    juce::AudioBuffer<float> buffer;
+    juce::MidiBuffer midi;
+    juce::Random random;
+    CallbackProfiler profiler;
+
+    juce::RangedAudioParameter* morphFactor = nullptr;
+    juce::RangedAudioParameter* magProcessing = nullptr;
+    juce::RangedAudioParameter* phaseProcessing = nullptr;
+    double automationPhase = 0.0;
+
+    void process(int numSamples, double sampleRate)
+    {
+        // Hosts deliver automation on the audio thread, just before the block.
+        automationPhase += numSamples / sampleRate * 0.5;
+        morphFactor->setValue(0.5f + 0.5f * (float) std::sin(juce::MathConstants<double>::twoPi * automationPhase));
+        if (random.nextInt(200) == 0) {
+            magProcessing->setValue(random.nextFloat());
+            phaseProcessing->setValue(random.nextFloat());
+        }
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch) {
+            auto* data = buffer.getWritePointer(ch);
+            for (int i = 0; i < numSamples; ++i) {
+                data[i] = random.nextFloat() * 0.5f - 0.25f;
+            }
+        }
+
+        juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numSamples);
+
+        auto start = juce::Time::getHighResolutionTicks();
+        processor->processBlock(block, midi);
+        auto elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+        profiler.addCallback(elapsed * 1.0e6, numSamples, sampleRate);
+    }
+};
+
+/**
+  A fixed pool of host threads that process every instance once per cycle,
+  taking instances from a shared counter like a host's graph scheduler.
+ */
+class StressHost
+{
+public:
+    StressHost(std::vector<std::unique_ptr<Instance>>& instancesToRun, int numThreads, double sampleRate) :
+        instances(instancesToRun), rate(sampleRate)
+    {
+        for (int i = 0; i < numThreads; ++i) {
+            threads.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~StressHost()
+    {
+        quit = true;
+        cycle.fetch_add(1);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Processes every instance once and returns the cycle's wall time.
+    double runCycle(int numSamples)
+    {
+        // A worker still leaving the last cycle may pick up an instance as
+        // soon as nextInstance is reset, so remaining has to be set first.
+        blockSize = numSamples;
+        remaining = (int) instances.size();
+        nextInstance = 0;
+
+        auto start = juce::Time::getHighResolutionTicks();
+        cycle.fetch_add(1, std::memory_order_release);
+
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            std::this_thread::yield();
+        }
+
+        return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+    }
+
+private:
+    void workerLoop()
+    {
+        juce::ScopedNoDenormals noDenormals;
+        int seenCycle = 0;
+
+        while (true) {
+            int current;
+            while ((current = cycle.load(std::memory_order_acquire)) == seenCycle) {
+                std::this_thread::yield();
+            }
+            seenCycle = current;
+
+            if (quit) {
+                return;
+            }
+
+            int index;
+            while ((index = nextInstance.fetch_add(1)) < (int) instances.size()) {
+                instances[(size_t) index]->process(blockSize, rate);
+                remaining.fetch_sub(1, std::memory_order_release);
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Instance>>& instances;
+    double rate;
+
+    std::vector<std::thread> threads;
+    std::atomic<int> cycle{ 0 };
+    std::atomic<int> nextInstance{ 0 };
+    std::atomic<int> remaining{ 0 };
+    std::atomic<bool> quit{ false };
+    std::atomic<int> blockSize{ 0 };
+};
+
+static double secondsSince(juce::int64 startTicks)
+{
+    return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+}
+
+// Renders the same main/aux pair with numPasses different settings, as an
+// offline morph search would: first straight through processSample(), then
+// from frames analysed once into a SpectralFrameCache. Returns 1 if the two
+// renders differ.
+static int runOfflineBenchmark(const StressOptions& options)
+{
+    const int numSamples = (int) (options.seconds * options.sampleRate);
+    std::vector<float> main(numSamples), aux(numSamples), direct(numSamples), cached(numSamples);
+
+    juce::Random random(42);
+    for (int i = 0; i < numSamples; ++i) {
+        main[i] = 0.5f * (float) std::sin(0.03 * i) + random.nextFloat() * 0.1f - 0.05f;
+        aux[i] = 0.4f * (float) std::sin(0.011 * i) + random.nextFloat() * 0.1f - 0.05f;
+    }
+
+    std::vector<ChainSettings> passes;
+    for (int pass = 0; pass < options.numPasses; ++pass) {
+        ChainSettings settings;
+        settings.morphFactor = (pass + 0.5f) / options.numPasses;
+        settings.magProcessing = (float) (pass % (magProcessing::linearBlend + 1));
+        settings.phaseProcessing = phaseProcessing::addP;
+        passes.push_back(settings);
+    }
+
+    std::cout << "Loom offline: " << options.numPasses << " passes of " << options.seconds << " s at "
+              << options.sampleRate << " Hz" << std::endl;
+
+    juce::ScopedNoDenormals noDenormals;
+    auto processor = std::make_unique<FFTProcessor>();
+    processor->setWindow(hannWindow, 4);
+
+    double directSeconds = 0.0, cachedSeconds = 0.0;
+    float maxDifference = 0.0f;
+
+    auto start = juce::Time::getHighResolutionTicks();
+    auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("LoomStress.lmsc");
+    if (!SpectralFrameCache::write(file, main.data(), aux.data(), numSamples, 10, 256, 1, SpectralFrameCache::float32)) {
+        std::cout << "can't write " << file.getFullPathName() << std::endl;
+        return 1;
+    }
+    SpectralFrameCache cache;
+    bool ok = cache.open(file);
+    const double analysisSeconds = secondsSince(start);
+
+    for (auto& settings : passes) {
+        processor->reset();
+        start = juce::Time::getHighResolutionTicks();
+        for (int i = 0; i < numSamples; ++i) {
+            direct[i] = processor->processSample(main[i], aux[i], settings);
+        }
+        directSeconds += secondsSince(start);
+
+        processor->reset();
+        start = juce::Time::getHighResolutionTicks();
+        ok = ok && processor->renderFromCache(cache, cached.data(), numSamples, settings);
+        cachedSeconds += secondsSince(start);
+
+        for (int i = 0; i < numSamples; ++i) {
+            maxDifference = juce::jmax(maxDifference, std::abs(direct[i] - cached[i]));
+        }
+    }
+
+    file.deleteFile();
+
+    std::cout << "direct renders:        " << juce::String(directSeconds, 3) << " s" << std::endl;
+    std::cout << "cache analysis:        " << juce::String(analysisSeconds, 3) << " s" << std::endl;
+    std::cout << "cached renders:        " << juce::String(cachedSeconds, 3) << " s ("
+              << juce::String(directSeconds / juce::jmax(cachedSeconds + analysisSeconds, 1.0e-9), 2)
+              << "x including analysis)" << std::endl;
+    std::cout << "max difference:        " << maxDifference << (ok ? "" : " (cache rejected)") << std::endl;
+
+    return ok && maxDifference == 0.0f ? 0 : 1;
+}
+
+/**
+  Runs processSpectrum() on its own, the part of a frame the mode settings
+  decide, without the transforms around it.
+ */
+struct SpectralBenchmark
+{
+    static int run(const StressOptions& options)
+    {
+        auto processor = std::make_unique<FFTProcessor>();
+
+        // Unpadded and 4x padded spectra of 1024-point frames.
+        const int maxFloats = 2 * ZeroPaddedFFT::getNumBins(1024, ZeroPaddedFFT::maxPadFactor);
+        std::vector<float> main(maxFloats), aux(maxFloats), work(maxFloats);
+
+        juce::Random random(5);
+        for (int i = 0; i < maxFloats; ++i) {
+            main[i] = random.nextFloat() - 0.5f;
+            aux[i] = random.nextFloat() - 0.5f;
+        }
+        const float* auxSpectra[FFTProcessor::maxAuxSources] = { aux.data(), aux.data(), nullptr };
+
+        std::cout << "Loom spectrum: " << options.numFrames << " frames per mode combination" << std::endl;
+
+        juce::ScopedNoDenormals noDenormals;
+        double totalSeconds = 0.0;
+        double checksum = 0.0;
+
+        for (int padFactor : { 1, ZeroPaddedFFT::maxPadFactor }) {
+            const int numBins = ZeroPaddedFFT::getNumBins(1024, padFactor);
+
+            for (int mag = magProcessing::addM; mag <= magProcessing::weightedMorph; ++mag) {
+                double seconds = 0.0;
+
+                for (int phase = phaseProcessing::addP; phase <= phaseProcessing::preserveAuxIn; ++phase) {
+                    for (int invert = 0; invert < 2; ++invert) {
+                        ChainSettings settings;
+                        settings.morphFactor = 0.3f;
+                        settings.magProcessing = (float) mag;
+                        settings.phaseProcessing = (float) phase;
+                        settings.invertPhase = (float) invert;
+
+                        auto start = juce::Time::getHighResolutionTicks();
+                        for (int frame = 0; frame < options.numFrames; ++frame) {
+                            std::copy(main.begin(), main.begin() + 2 * numBins, work.begin());
+                            processor->processSpectrum(work.data(), auxSpectra, numBins, settings);
+
+                            // Also keeps the work from being optimised away.
+                            checksum += work[frame % (2 * numBins)];
+                        }
+                        seconds += secondsSince(start);
+                    }
+                }
+
+                std::cout << numBins << " bins, mag mode " << mag << ":   "
+                          << juce::String(seconds * 1000.0, 1) << " ms" << std::endl;
+                totalSeconds += seconds;
+            }
+        }
+
+        std::cout << "total:                 " << juce::String(totalSeconds * 1000.0, 1) << " ms" << std::endl;
+        std::cout << "checksum:              " << checksum << std::endl;
+        return 0;
+    }
+};
+
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::StringArray args;
+    for (int i = 1; i < argc; ++i) {
+        args.add(argv[i]);
+    }
+    auto options = parseOptions(args);
+
+    if (options.offline) {
+        return runOfflineBenchmark(options);
+    }
+    if (options.spectrum) {
+        return SpectralBenchmark::run(options);
+    }
+
+    std::cout << "Loom stress: " << options.numInstances << " instances, " << options.numThreads
+              << " host threads, " << options.sampleRate << " Hz, blocks 32-" << options.maxBlockSize
+              << (options.pipelined ? ", pipelined" : "") << (options.realtime ? ", paced in real time" : "")
+              << (options.compareStagger ? ", hop stagger off then on" : "") << std::endl;
+
+    // Memory is measured around creation and preparation, since most of an
+    // instance's buffers are allocated in its constructor and prepareToPlay.
+    auto residentBefore = getResidentBytes();
+
+    std::vector<std::unique_ptr<Instance>> instances;
+    for (int i = 0; i < options.numInstances; ++i) {
+        auto instance = std::make_unique<Instance>();
+        instance->processor.reset(createPluginFilter());
+        instance->random.setSeed(1234 + i);
+
+        auto* loom = dynamic_cast<LoomAudioProcessor*>(instance->processor.get());
+        jassert(loom != nullptr);
+
+        instance->morphFactor = loom->apvts.getParameter("morphFactor");
+        instance->magProcessing = loom->apvts.getParameter("magProcessing");
+        instance->phaseProcessing = loom->apvts.getParameter("phaseProcessing");
+        if (auto* pipelined = loom->apvts.getParameter("pipelined")) {
+            pipelined->setValue(options.pipelined ? 1.0f : 0.0f);
+        }
+        if (options.compareStagger) {
+            loom->apvts.getParameter("hopStagger")->setValue(0.0f);
+            loom->apvts.getParameter("measureCallbacks")->setValue(1.0f);
+        }
+
+        auto& processor = *instance->processor;
+        processor.setRateAndBufferSizeDetails(options.sampleRate, options.maxBlockSize);
+        processor.prepareToPlay(options.sampleRate, options.maxBlockSize);
+
+        instance->buffer.setSize(juce::jmax(processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels()),
+                                 options.maxBlockSize);
+        instances.push_back(std::move(instance));
+    }
+
+    auto residentAfter = getResidentBytes();
+
+    StressHost host(instances, options.numThreads, options.sampleRate);
+    juce::Random random(42);
+
+    juce::int64 numCycles = 0, numMisses = 0, samplesRendered = 0;
+    double worstCycleLoad = 0.0, worstCycleMicroseconds = 0.0;
+    const auto totalSamples = (juce::int64) (options.seconds * options.sampleRate);
+    auto wallStart = juce::Time::getMillisecondCounterHiRes();
+
+    bool staggerSwitched = false;
+
+    while (samplesRendered < totalSamples) {
+        // Stagger is only picked up in prepareToPlay(), as a host would
+        // apply it after stopping playback.
+        if (options.compareStagger && !staggerSwitched && samplesRendered >= totalSamples / 2) {
+            for (auto& instance : instances) {
+                auto* loom = dynamic_cast<LoomAudioProcessor*>(instance->processor.get());
+                loom->apvts.getParameter("hopStagger")->setValue(1.0f);
+                loom->releaseResources();
+                loom->prepareToPlay(options.sampleRate, options.maxBlockSize);
+            }
+            staggerSwitched = true;
+        }
+
+        int numSamples = nextBlockSize(random, options.maxBlockSize);
+        double budget = numSamples / options.sampleRate;
+
+        double elapsed = host.runCycle(numSamples);
+
+        numCycles += 1;
+        if (elapsed > budget) {
+            numMisses += 1;
+        }
+        worstCycleLoad = juce::jmax(worstCycleLoad, elapsed / budget);
+        worstCycleMicroseconds = juce::jmax(worstCycleMicroseconds, elapsed * 1.0e6);
+        samplesRendered += numSamples;
+
+        // Like a real device, the next cycle doesn't start until its period.
+        if (options.realtime) {
+            auto due = wallStart + samplesRendered * 1000.0 / options.sampleRate;
+            while (juce::Time::getMillisecondCounterHiRes() < due) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+    auto wallSeconds = (juce::Time::getMillisecondCounterHiRes() - wallStart) / 1000.0;
+
+    CallbackProfiler::Stats worst;
+    double meanSum = 0.0;
+    for (auto& instance : instances) {
+        auto stats = instance->profiler.getStats();
+        meanSum += stats.meanMicroseconds;
+        if (stats.worstMicroseconds > worst.worstMicroseconds) {
+            worst = stats;
+        }
+    }
+
+    std::cout << "cycles:                " << numCycles << " (" << wallSeconds << " s wall for "
+              << options.seconds << " s audio)" << std::endl;
+    std::cout << "deadline misses:       " << numMisses << " ("
+              << juce::String(100.0 * numMisses / juce::jmax((juce::int64) 1, numCycles), 2) << "%)" << std::endl;
+    std::cout << "worst cycle:           " << juce::String(worstCycleMicroseconds, 1) << " us, load "
+              << juce::String(worstCycleLoad, 3) << std::endl;
+    std::cout << "worst callback:        " << juce::String(worst.worstMicroseconds, 1) << " us, load "
+              << juce::String(worst.worstLoad, 3) << std::endl;
+    std::cout << "mean callback:         " << juce::String(meanSum / instances.size(), 1) << " us" << std::endl;
+    std::cout << "memory per instance:   "
+              << (residentAfter > 0 ? juce::File::descriptionOfSizeInBytes((residentAfter - residentBefore) / options.numInstances)
+                                    : juce::String("unknown"))
+              << " resident, " << juce::File::descriptionOfSizeInBytes((juce::int64) sizeof(LoomAudioProcessor))
+              << " object" << std::endl;
+
+    if (options.compareStagger) {
+        for (bool staggered : { false, true }) {
+            CallbackProfiler::Stats worstStats;
+            double sum = 0.0;
+            for (auto& instance : instances) {
+                auto stats = dynamic_cast<LoomAudioProcessor*>(instance->processor.get())->getCallbackStats(staggered);
+                sum += stats.meanMicroseconds;
+                if (stats.worstMicroseconds > worstStats.worstMicroseconds) {
+                    worstStats = stats;
+                }
+            }
+
+            std::cout << (staggered ? "hop stagger on:        " : "hop stagger off:       ")
+                      << "worst " << juce::String(worstStats.worstMicroseconds, 1) << " us, load "
+                      << juce::String(worstStats.worstLoad, 3) << ", mean "
+                      << juce::String(sum / instances.size(), 1) << " us" << std::endl;
+        }
+    }
+
+    for (auto& instance : instances) {
+        instance->processor->releaseResources();
+    }
+
+    return numMisses > 0 ? 1 : 0;
+}
@@ -0,0 +1,466 @@
+/*
+  ==============================================================================
+
+    Regression tests for Loom's STFT engine.
+
+    Renders fixed stimuli through FFTProcessor and checks them against the
+    golden renders in Tools/LoomTests/Golden, within the ULP/dB tolerance
+    of STFTReference::compare(). Also checks perfect reconstruction for every
+    window and overlap, and the paths that are meant to match the plain
+    one exactly: pipelined mode (one hop later), renders from a
+    SpectralFrameCache, and the specialised spectral kernels. Also checks
+    that SharedAuxCache keeps spectra of different frame sizes and windows
+    apart.
+
+    Usage: LoomTests [--golden DIR] [--update-golden]
+
+    The golden files are the output of the reference path, not of the
+    current build: the separate magnitude, phase and inversion passes
+    processSpectrum() ran before any of the optimisations, with
+    juce::dsp::FFT, and for Weighted Morph, which those passes didn't have,
+    the first version of that mode.
+
+    --update-golden rewrites the golden files from the current build. Only
+    do that for a change that is meant to alter the output, and say so in
+    its commit.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/DSP/STFTReference.h"
+#include "../../../Source/DSP/SpectralFrameCache.h"
+#include "../../../Source/DSP/SpectralKernels.h"
+#include "../../../Source/DSP/SharedAuxCache.h"
+
+struct TestOptions
+{
+    // Next to this file's Source folder, so a local build finds it wherever
+    // the executable ends up.
+    juce::File goldenDirectory = juce::File(__FILE__).getParentDirectory().getSiblingFile("Golden");
+    bool updateGolden = false;
+};
+
+static TestOptions options;
+
+// Long enough for the output to settle for a good twenty hops after the
+// latency, short enough to keep the golden files small.
+static constexpr int numTestSamples = 6144;
+static constexpr double testSampleRate = 48000.0;
+
+struct Stimulus
+{
+    Stimulus() : main(numTestSamples), aux(numTestSamples)
+    {
+        STFTReference::fillStimulus(main.data(), aux.data(), numTestSamples, testSampleRate);
+    }
+
+    std::vector<float> main, aux;
+};
+
+static juce::String describe(const STFTAccuracyReport& report)
+{
+    return "SNR " + juce::String(report.snrDb, 1) + " dB, max error " + juce::String(report.maxErrorDb, 1)
+         + " dB, " + juce::String(report.maxUlps) + " ulps";
+}
+
+static juce::String describe(ChainSettings settings)
+{
+    return "mag " + juce::String((int) settings.magProcessing) + ", phase " + juce::String((int) settings.phaseProcessing)
+         + ", invert " + juce::String((int) settings.invertPhase);
+}
+
+//==============================================================================
+class ReconstructionTests : public juce::UnitTest
+{
+public:
+    ReconstructionTests() : juce::UnitTest("STFT reconstruction", "Loom") {}
+
+    void runTest() override
+    {
+        Stimulus stimulus;
+
+        for (int family = hannWindow; family <= kaiserWindow; ++family) {
+            for (int overlap = 2; overlap <= 8; overlap *= 2) {
+                beginTest("window " + juce::String(family) + ", overlap " + juce::String(overlap));
+
+                auto report = STFTReference::checkReconstruction(stimulus.main.data(), numTestSamples, {},
+                                                                 (windowFamily) family, overlap);
+                expect(report.withinTolerance, describe(report));
+            }
+        }
+    }
+};
+
+//==============================================================================
+class GoldenRenderTests : public juce::UnitTest
+{
+public:
+    GoldenRenderTests() : juce::UnitTest("Golden renders", "Loom") {}
+
+    void runTest() override
+    {
+        Stimulus stimulus;
+        std::vector<float> output(numTestSamples);
+
+        for (auto settings : STFTReference::getAllModeSettings()) {
+            beginTest(describe(settings));
+
+            STFTReference::render(stimulus.main.data(), stimulus.aux.data(), output.data(), numTestSamples, settings);
+            auto file = options.goldenDirectory.getChildFile(getGoldenName(settings));
+
+            if (options.updateGolden) {
+                options.goldenDirectory.createDirectory();
+                expect(STFTReference::writeGolden(file, output.data(), numTestSamples), "can't write " + file.getFullPathName());
+                continue;
+            }
+
+            std::vector<float> golden;
+            if (!STFTReference::readGolden(file, golden) || (int) golden.size() != numTestSamples) {
+                expect(false, "missing or truncated golden file " + file.getFullPathName());
+                continue;
+            }
+
+            auto report = STFTReference::compare(golden.data(), output.data(), numTestSamples, {});
+            expect(report.withinTolerance, describe(report));
+        }
+    }
+
+private:
+    static juce::String getGoldenName(ChainSettings settings)
+    {
+        return "mag" + juce::String((int) settings.magProcessing) + "_phase" + juce::String((int) settings.phaseProcessing)
+             + "_invert" + juce::String((int) settings.invertPhase) + ".golden";
+    }
+};
+
+//==============================================================================
+class PipelinedTests : public juce::UnitTest
+{
+public:
+    PipelinedTests() : juce::UnitTest("Pipelined mode", "Loom") {}
+
+    void runTest() override
+    {
+        Stimulus stimulus;
+        std::vector<float> plain(numTestSamples), pipelined(numTestSamples);
+
+        for (int overlap = 1; overlap <= 3; ++overlap) {
+            for (auto settings : { makeSettings(magProcessing::addM, phaseProcessing::addP, overlap),
+                                   makeSettings(magProcessing::linearBlend, phaseProcessing::preserveAuxIn, overlap),
+                                   makeSettings(magProcessing::weightedMorph, phaseProcessing::preserveMainIn, overlap) }) {
+                beginTest(describe(settings) + ", overlap " + juce::String(1 << overlap));
+
+                STFTReference::render(stimulus.main.data(), stimulus.aux.data(), plain.data(), numTestSamples, settings);
+                settings.pipelined = 1.0f;
+                STFTReference::render(stimulus.main.data(), stimulus.aux.data(), pipelined.data(), numTestSamples, settings);
+
+                // The same frames, overlap-added one hop later.
+                const int hopSize = 1024 >> overlap;
+                auto report = STFTReference::compare(plain.data(), pipelined.data() + hopSize, numTestSamples - hopSize,
+                                                     exact());
+                expect(report.withinTolerance && report.maxUlps == 0, describe(report));
+            }
+        }
+    }
+
+private:
+    static ChainSettings makeSettings(int mag, int phase, int overlap)
+    {
+        ChainSettings settings;
+        settings.morphFactor = 0.3f;
+        settings.magProcessing = (float) mag;
+        settings.phaseProcessing = (float) phase;
+        settings.overlap = (float) overlap;
+        return settings;
+    }
+
+    static STFTTolerance exact() { return { 0, -1000.0 }; }
+};
+
+//==============================================================================
+class FrameCacheTests : public juce::UnitTest
+{
+public:
+    FrameCacheTests() : juce::UnitTest("Spectral frame cache", "Loom") {}
+
+    void runTest() override
+    {
+        Stimulus stimulus;
+        auto file = juce::File::getSpecialLocation(juce::File::tempDirectory).getChildFile("LoomTests.lmsc");
+
+        ChainSettings settings;
+        settings.morphFactor = 0.3f;
+        settings.phaseProcessing = phaseProcessing::addP;
+
+        for (int zeroPadding = 0; zeroPadding <= 2; ++zeroPadding) {
+            settings.zeroPadding = (float) zeroPadding;
+
+            std::vector<float> reference(numTestSamples);
+            STFTReference::render(stimulus.main.data(), stimulus.aux.data(), reference.data(), numTestSamples, settings);
+
+            for (auto format : { SpectralFrameCache::float32, SpectralFrameCache::float16, SpectralFrameCache::quantizedPolar }) {
+                beginTest("format " + juce::String((int) format) + ", padding " + juce::String(1 << zeroPadding));
+
+                expect(SpectralFrameCache::write(file, stimulus.main.data(), stimulus.aux.data(), numTestSamples,
+                                                 10, 256, 1 << zeroPadding, format));
+
+                SpectralFrameCache cache;
+                expect(cache.open(file));
+
+                auto processor = std::make_unique<FFTProcessor>();
+                processor->setWindow(hannWindow, 4);
+                processor->reset();
+
+                std::vector<float> output(numTestSamples);
+                expect(processor->renderFromCache(cache, output.data(), numTestSamples, settings));
+
+                auto report = STFTReference::compare(reference.data(), output.data(), numTestSamples, {});
+
+                // float32 frames are the frames processSample() computes, so
+                // the output matches bit for bit. The smaller formats only
+                // have to stay well below audibility: 16-bit floats keep
+                // about 75 dB, 16-bit log magnitudes a little less.
+                if (format == SpectralFrameCache::float32) {
+                    expect(report.maxUlps == 0, describe(report));
+                }
+                else {
+                    expect(report.snrDb > (format == SpectralFrameCache::float16 ? 70.0 : 60.0), describe(report));
+                }
+            }
+        }
+
+        beginTest("mismatched processor");
+        {
+            expect(SpectralFrameCache::write(file, stimulus.main.data(), stimulus.aux.data(), numTestSamples,
+                                             10, 256, 1, SpectralFrameCache::float32));
+            SpectralFrameCache cache;
+            expect(cache.open(file));
+
+            // Hops of 128 rather than the cache's 256.
+            auto processor = std::make_unique<FFTProcessor>();
+            processor->setWindow(hannWindow, 8);
+            processor->reset();
+
+            std::vector<float> output(numTestSamples, 1.0f);
+            expect(!processor->renderFromCache(cache, output.data(), numTestSamples, settings));
+            expect(std::all_of(output.begin(), output.end(), [](float x) { return x == 0.0f; }), "output not cleared");
+        }
+
+        beginTest("invalid headers");
+        {
+            // Offsets of the header fields open() has to check.
+            constexpr int fftSizeOffset = 8, padFactorOffset = 16, numBinsOffset = 20;
+
+            for (auto [offset, value] : { std::pair<int, juce::int32>{ padFactorOffset, 3 },
+                                          { padFactorOffset, 8 },
+                                          { numBinsOffset, 514 },
+                                          { fftSizeOffset, 1000 } }) {
+                expect(SpectralFrameCache::write(file, stimulus.main.data(), stimulus.aux.data(), numTestSamples,
+                                                 10, 256, 1, SpectralFrameCache::float32));
+
+                juce::MemoryBlock data;
+                expect(file.loadFileAsData(data));
+                std::memcpy(static_cast<char*>(data.getData()) + offset, &value, sizeof(value));
+                expect(file.replaceWithData(data.getData(), data.getSize()));
+
+                SpectralFrameCache cache;
+                expect(!cache.open(file), "opened with " + juce::String(value) + " at offset " + juce::String(offset));
+            }
+        }
+
+        file.deleteFile();
+    }
+};
+
+//==============================================================================
+class SpectralKernelTests : public juce::UnitTest
+{
+public:
+    SpectralKernelTests() : juce::UnitTest("Spectral kernels", "Loom") {}
+
+    void runTest() override
+    {
+        constexpr int numBins = 513;
+        std::vector<std::complex<float>> main(numBins), aux(numBins), kernelOutput(numBins), referenceOutput(numBins);
+
+        juce::Random random(7);
+        for (int i = 0; i < numBins; ++i) {
+            main[i] = { random.nextFloat() * 4.0f - 2.0f, random.nextFloat() * 4.0f - 2.0f };
+            aux[i] = { random.nextFloat() * 4.0f - 2.0f, random.nextFloat() * 4.0f - 2.0f };
+        }
+
+        // Silent bins take the zero-magnitude paths.
+        main[3] = aux[5] = main[7] = aux[7] = 0.0f;
+
+        // Bins whose phase rounds to just above pi, which a trip through
+        // polar form turns into -pi.
+        main[11] = { -1.5f, 1.0e-8f };
+        main[12] = { -0.25f, 1.0e-9f };
+        aux[12] = { -0.5f, 1.0e-8f };
+
+        auto table = MorphCurve().createTable(1024);
+
+        SpectralKernels::Params params;
+        params.morphFactor = 0.3f;
+        params.blendCurve = table->getGains(numBins);
+
+        for (int mag = 0; mag < SpectralKernels::numMagModes; ++mag) {
+            for (int phase = 0; phase < SpectralKernels::numPhaseModes; ++phase) {
+                for (int invert = 0; invert < 2; ++invert) {
+                    beginTest("mag " + juce::String(mag) + ", phase " + juce::String(phase) + ", invert " + juce::String(invert));
+
+                    kernelOutput = main;
+                    SpectralKernels::get(mag, phase, invert != 0)(kernelOutput.data(), aux.data(), numBins, params);
+
+                    for (int i = 0; i < numBins; ++i) {
+                        referenceOutput[i] = processBin(main[i], aux[i], i, numBins, mag, phase, invert != 0, params);
+                    }
+
+                    float maxError = 0.0f;
+                    for (int i = 0; i < numBins; ++i) {
+                        maxError = juce::jmax(maxError, std::abs(kernelOutput[i] - referenceOutput[i]));
+                    }
+                    expect(maxError < 1.0e-5f, "max error " + juce::String(maxError));
+                }
+            }
+        }
+    }
+
+private:
+    // The modes as the separate passes processSpectrum() ran before the
+    // kernels: the magnitude mode, the phase mode and phase inversion, each
+    // reading the bin back from polar form and converting it back again.
+    // Linear Blend reads the drawn curve, which replaced its fixed ramp.
+    static std::complex<float> processBin(std::complex<float> bin, std::complex<float> binA, int index, int numBins,
+                                          int magMode, int phaseMode, bool invert, const SpectralKernels::Params& params)
+    {
+        const float m = params.morphFactor;
+        const float magnitudeA = std::abs(binA), phaseA = std::arg(binA);
+        const float linearPhase = -3.14f + (3.14f - -3.14f) / (numBins - 1) * index;
+
+        auto magnitudePass = [&](float magnitude) {
+            switch (magMode)
+            {
+            case magProcessing::addM: return (magnitude * m) + (magnitudeA * (1.0f - m));
+            case magProcessing::subtract: return std::abs((magnitude * m) - (magnitudeA * (1.0f - m)));
+            case magProcessing::multiply: return std::abs((magnitude * m) * (magnitudeA * (1.0f - m))) / std::max(magnitude * magnitudeA, 1.0f);
+            case magProcessing::divide: return std::min((magnitude * m) / std::max(magnitudeA * (1.0f - m), 1e-6f), 1.0f);
+            case magProcessing::linearBlend: return params.blendCurve[index] * magnitudeA + (1.0f - params.blendCurve[index]) * magnitude;
+            default: return magnitude;
+            }
+        };
+
+        auto wrap = [](float phase) {
+            if (phase > 3.14f) phase -= 2.0f * 3.14f;
+            if (phase < -3.14f) phase += 2.0f * 3.14f;
+            return phase;
+        };
+
+        auto phasePass = [&](float phase) {
+            float average = (phase * m) + (phaseA * (1.0f - m));
+            float smooth = 3 * m * m - 2 * m * m * m;
+
+            switch (phaseMode)
+            {
+            case phaseProcessing::addP: return average;
+            case phaseProcessing::linear: return wrap(linearPhase);
+            case phaseProcessing::linearNatural: return wrap((1.0f - m) * average + m * linearPhase);
+            case phaseProcessing::smoothStep: return smooth * phase + (1 - smooth) * phaseA;
+            case phaseProcessing::preserveAuxIn: return phaseA;
+            default: return phase;
+            }
+        };
+
+        if (magMode != magProcessing::allPass) {
+            bin = std::polar(magnitudePass(std::abs(bin)), std::arg(bin));
+        }
+        if (phaseMode != phaseProcessing::preserveMainIn) {
+            bin = std::polar(std::abs(bin), phasePass(std::arg(bin)));
+        }
+        if (invert) {
+            bin = std::polar(std::abs(bin), -std::arg(bin));
+        }
+        return bin;
+    }
+};
+
+class SharedAuxCacheTests : public juce::UnitTest
+{
+public:
+    SharedAuxCacheTests() : juce::UnitTest("Shared aux cache", "Loom") {}
+
+    void runTest() override
+    {
+        // A 2048-point frame and a 1024-point one padded 2x both give 1025
+        // bins, so the same number of floats.
+        constexpr int size = 1025 * 2;
+        constexpr juce::int64 frame = 4096;
+        std::vector<float> published(size, 1.0f), fetched(size, 0.0f);
+
+        SharedAuxCache cache;
+
+        beginTest("Same frame size");
+        cache.publish(1, 0, frame, 2048, size, 0, published.data());
+        expect(cache.fetch(1, 0, frame, 2048, size, 0, fetched.data()));
+        expect(fetched == published);
+
+        beginTest("Same spectrum size, different frame size");
+        expect(!cache.fetch(1, 0, frame, 1024, size, 0, fetched.data()));
+
+        beginTest("Different frame size publishes over the slot");
+        std::fill(published.begin(), published.end(), 2.0f);
+        cache.publish(1, 0, frame, 1024, size, 0, published.data());
+        expect(cache.fetch(1, 0, frame, 1024, size, 0, fetched.data()));
+        expect(fetched == published);
+        expect(!cache.fetch(1, 0, frame, 2048, size, 0, fetched.data()));
+
+        beginTest("Different window publishes over the slot");
+        std::fill(published.begin(), published.end(), 3.0f);
+        cache.publish(1, 0, frame, 1024, size, 1, published.data());
+        expect(cache.fetch(1, 0, frame, 1024, size, 1, fetched.data()));
+        expect(fetched == published);
+
+        beginTest("Largest planned frame, padded 4x");
+        std::vector<float> large(SharedAuxCache::maxSpectrumSize, 4.0f), largeFetched(large.size(), 0.0f);
+        cache.publish(2, 0, frame, 4096, (int) large.size(), 0, large.data());
+        expect(cache.fetch(2, 0, frame, 4096, (int) large.size(), 0, largeFetched.data()));
+        expect(largeFetched == large);
+    }
+};
+
+static ReconstructionTests reconstructionTests;
+static GoldenRenderTests goldenRenderTests;
+static PipelinedTests pipelinedTests;
+static FrameCacheTests frameCacheTests;
+static SpectralKernelTests spectralKernelTests;
+static SharedAuxCacheTests sharedAuxCacheTests;
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    for (int i = 1; i < argc; ++i) {
+        juce::String arg(argv[i]);
+
+        if (arg == "--update-golden") options.updateGolden = true;
+        else if (arg == "--golden" && i + 1 < argc) options.goldenDirectory = juce::File(juce::String(argv[++i]));
+    }
+
+    std::cout << "Golden files: " << options.goldenDirectory.getFullPathName()
+              << (options.updateGolden ? " (updating)" : "") << std::endl;
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("Loom");
+
+    int numPasses = 0, numFailures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i) {
+        numPasses += runner.getResult(i)->passes;
+        numFailures += runner.getResult(i)->failures;
+    }
+
+    std::cout << numPasses << " passed, " << numFailures << " failed" << std::endl;
+    return numFailures > 0 ? 1 : 0;
+}